@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "lib/mooboy.h"
+
+/*
+    Runs every ROM of a list of directories and files headless, each for a
+    deadline in emulated time, and reports one JSON line per ROM.
+
+    Every worker thread runs an emulator of its own and claims the next
+    unclaimed ROM whenever it finished one, so slow ROMs don't hold up the
+    others. The emulators' own output goes to stderr, stdout carries only
+    the report. Deadlines and the reported cycles are single speed M-cycles,
+    so ROMs in CGB double speed run as long and report in the same units.
+*/
+
+#define MCS_PER_SECOND 1048576
+
+typedef struct {
+    char *path;
+
+    int loaded;
+    int frames;
+    uint64_t cycles;
+    double seconds;
+    int mbc;
+    uint32_t hash;
+    char error[256];
+} job_t;
+
+static job_t *jobs = NULL;
+static int num_jobs = 0;
+static int next_job = 0;
+
+static uint64_t deadline;
+static FILE *report;
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_rom(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext != NULL && (strcasecmp(ext, ".gb") == 0 || strcasecmp(ext, ".gbc") == 0);
+}
+
+static void add_job(const char *path) {
+    jobs = realloc(jobs, sizeof(*jobs) * (num_jobs + 1));
+    memset(&jobs[num_jobs], 0x00, sizeof(*jobs));
+    jobs[num_jobs].path = strdup(path);
+    num_jobs++;
+}
+
+static int compare_jobs(const void *a, const void *b) {
+    return strcmp(((const job_t*)a)->path, ((const job_t*)b)->path);
+}
+
+static void add_path(const char *path) {
+    struct stat st;
+    DIR *dir;
+    struct dirent *entry;
+
+    if(stat(path, &st) != 0) {
+        fprintf(stderr, "No such file or directory '%s'\n", path);
+        return;
+    }
+    if(!S_ISDIR(st.st_mode)) {
+        add_job(path);
+        return;
+    }
+
+    dir = opendir(path);
+    if(dir == NULL) {
+        fprintf(stderr, "Failed to open directory '%s'\n", path);
+        return;
+    }
+    while((entry = readdir(dir)) != NULL) {
+        char sub[4096];
+
+        if(entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(sub, sizeof(sub), "%s/%s", path, entry->d_name);
+        if(stat(sub, &st) == 0 && S_ISDIR(st.st_mode)) {
+            add_path(sub);
+        }
+        else if(is_rom(entry->d_name)) {
+            add_job(sub);
+        }
+    }
+    closedir(dir);
+}
+
+static void print_string(const char *str) {
+    const char *c;
+
+    fputc('"', report);
+    for(c = str; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            fprintf(report, "\\%c", *c);
+        }
+        else if((unsigned char)*c < 0x20) {
+            fprintf(report, "\\u%.4x", *c);
+        }
+        else {
+            fputc(*c, report);
+        }
+    }
+    fputc('"', report);
+}
+
+static void print_job(const job_t *job) {
+    pthread_mutex_lock(&report_mutex);
+
+    fprintf(report, "{\"rom\": ");
+    print_string(job->path);
+    if(job->loaded) {
+        fprintf(report, ", \"mbc\": %d, \"frames\": %d, \"cycles\": %llu, \"seconds\": %.3f, \"cycles_per_sec\": %.0f, \"hash\": \"%.8x\"",
+                job->mbc, job->frames, (unsigned long long)job->cycles, job->seconds,
+                job->seconds > 0.0 ? job->cycles / job->seconds : 0.0, job->hash);
+    }
+    fprintf(report, ", \"error\": ");
+    if(job->error[0] != '\0') {
+        print_string(job->error);
+    }
+    else {
+        fprintf(report, "null");
+    }
+    fprintf(report, "}\n");
+    fflush(report);
+
+    pthread_mutex_unlock(&report_mutex);
+}
+
+static void run_job(job_t *job) {
+    double start;
+    const char *error;
+
+    mooboy_init();
+
+    start = now();
+    job->loaded = mooboy_load_rom_file(job->path);
+    if(job->loaded) {
+        while(mooboy_elapsed_mcs() < deadline && mooboy_error() == NULL) {
+            if(mooboy_run_frames(1) == 0) {
+                break;
+            }
+            job->frames++;
+        }
+        job->seconds = now() - start;
+        job->cycles = mooboy_elapsed_mcs();
+        job->mbc = mooboy_mbc();
+        job->hash = mooboy_framebuffer_hash();
+    }
+
+    error = mooboy_error();
+    if(error != NULL) {
+        snprintf(job->error, sizeof(job->error), "%s", error);
+    }
+
+    mooboy_close();
+}
+
+static void *worker(void *arg) {
+    int j;
+
+    while((j = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < num_jobs) {
+        run_job(&jobs[j]);
+        print_job(&jobs[j]);
+    }
+
+    return NULL;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-j threads] [-m emulated minutes] [-c M-cycles] <rom or directory>...\n", name);
+}
+
+int main(int argc, char **argv) {
+    pthread_t *threads;
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, t;
+
+    deadline = 60ULL * MCS_PER_SECOND;
+
+    while((opt = getopt(argc, argv, "j:m:c:")) != -1) {
+        switch(opt) {
+            case 'j': num_threads = atoi(optarg); break;
+            case 'm': deadline = (uint64_t)(atof(optarg) * 60 * MCS_PER_SECOND); break;
+            case 'c': deadline = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if(optind >= argc || num_threads < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for(; optind < argc; optind++) {
+        add_path(argv[optind]);
+    }
+    qsort(jobs, num_jobs, sizeof(*jobs), compare_jobs);
+
+    // Keep stdout for the report
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    num_threads = num_threads < num_jobs ? num_threads : num_jobs;
+    threads = malloc(sizeof(*threads) * num_threads);
+    for(t = 0; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, worker, NULL);
+    }
+    for(t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    fclose(report);
+    free(threads);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#include "fixture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib/mooboy.h"
+#include "romgen/romgen.h"
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *file;
+    uint8_t *data;
+    long length;
+
+    file = fopen(path, "rb");
+    if(file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data = malloc(length > 0 ? length : 1);
+    if(length <= 0 || fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    *size = length;
+
+    fclose(file);
+    return data;
+}
+
+// The ROM is malloc()ed, NULL and a message on stderr if there is none
+uint8_t *fixture_load_rom(const char *spec, size_t *size) {
+    uint8_t *rom;
+
+    if(strncmp(spec, FIXTURE_SYNTH_PREFIX, strlen(FIXTURE_SYNTH_PREFIX)) == 0) {
+        int workload = romgen_workload(spec + strlen(FIXTURE_SYNTH_PREFIX));
+
+        if(workload < 0) {
+            fprintf(stderr, "No synthetic ROM '%s'\n", spec);
+            return NULL;
+        }
+        return romgen_build(workload, size);
+    }
+
+    rom = read_file(spec, size);
+    if(rom == NULL) {
+        fprintf(stderr, "Failed to read ROM '%s'\n", spec);
+    }
+    return rom;
+}
+
+void fixture_script_init(fixture_script_t *script) {
+    memset(script, 0x00, sizeof(*script));
+}
+
+void fixture_script_free(fixture_script_t *script) {
+    free(script->inputs);
+    fixture_script_init(script);
+}
+
+static int parse_buttons(const char *str, uint8_t *buttons) {
+    static const char *names[8] = {"right", "left", "up", "down", "a", "b", "select", "start"};
+    char copy[256];
+    char *name;
+    int b;
+
+    *buttons = 0;
+    if(strcmp(str, "-") == 0) {
+        return 1;
+    }
+
+    snprintf(copy, sizeof(copy), "%s", str);
+    for(name = strtok(copy, "+"); name != NULL; name = strtok(NULL, "+")) {
+        for(b = 0; b < 8 && strcmp(name, names[b]) != 0; b++) {}
+        if(b == 8) {
+            return 0;
+        }
+        *buttons |= 1 << b;
+    }
+
+    return 1;
+}
+
+/*
+    A line of "<frame> <buttons>", buttons joined by '+' or "-" for none,
+    e.g. "120 start" or "300 a+right". The buttons are held from that
+    frame on until the next line. Frames have to ascend. Returns 0 if the
+    line is invalid.
+*/
+int fixture_script_add(fixture_script_t *script, const char *line) {
+    fixture_input_t input;
+    char buttons[256];
+
+    if(sscanf(line, "%d %255s", &input.frame, buttons) != 2 || !parse_buttons(buttons, &input.buttons) ||
+       (script->length > 0 && input.frame < script->inputs[script->length - 1].frame)) {
+        return 0;
+    }
+
+    script->inputs = realloc(script->inputs, sizeof(*script->inputs) * (script->length + 1));
+    script->inputs[script->length++] = input;
+
+    return 1;
+}
+
+// Lines as for fixture_script_add(), empty lines and lines starting with '#' are ignored
+int fixture_script_load(fixture_script_t *script, const char *path) {
+    FILE *file;
+    char line[256];
+    int number = 0;
+
+    file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open input script '%s'\n", path);
+        return 0;
+    }
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        if(line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if(!fixture_script_add(script, line)) {
+            fprintf(stderr, "%s:%d: Invalid input '%s'\n", path, number, strtok(line, "\r\n"));
+            fclose(file);
+            return 0;
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+void fixture_script_rewind(fixture_script_t *script) {
+    script->next = 0;
+}
+
+// Sets the buttons for frame, frames are applied in ascending order
+void fixture_script_apply(fixture_script_t *script, int frame) {
+    for(; script->next < script->length && script->inputs[script->next].frame <= frame; script->next++) {
+        mooboy_set_buttons(script->inputs[script->next].buttons);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_FIXTURE_H
+#define BENCH_FIXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    What the bench and regression tools run: A ROM, either a file or a
+    synthetic one ("synth:<workload>", see romgen), and a script of the
+    buttons held from a frame on.
+*/
+
+#define FIXTURE_SYNTH_PREFIX "synth:"
+
+typedef struct {
+    int frame;
+    uint8_t buttons;
+} fixture_input_t;
+
+typedef struct {
+    fixture_input_t *inputs;
+    int length;
+    int next;
+} fixture_script_t;
+
+uint8_t *fixture_load_rom(const char *spec, size_t *size);
+
+void fixture_script_init(fixture_script_t *script);
+void fixture_script_free(fixture_script_t *script);
+int fixture_script_add(fixture_script_t *script, const char *line);
+int fixture_script_load(fixture_script_t *script, const char *path);
+void fixture_script_rewind(fixture_script_t *script);
+void fixture_script_apply(fixture_script_t *script, int frame);
+
+#endif
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "lib/mooboy.h"
+#include "bench/fixture.h"
+
+/*
+    Regression check against golden hashes: Runs the ROM of every golden
+    file for its frames with its input and compares the hash of every
+    frame, and of the audio of every emulated second, with the recorded
+    ones. Each file is checked in every render mode. On a difference the
+    first diverging frame and line and the first diverging second of
+    audio are reported.
+
+    The headless emulator reads no clock and no files besides the ROM, so
+    runs are deterministic, RTCs tick with the emulated cycles.
+
+    A golden file is text:
+        rom <synth:workload or path, relative to the golden file>
+        frames <n>
+        input <frame> <buttons>         Optional, see fixture_script_add()
+        frame <n> <hash> <line digests> One per frame
+        audio <second> <hash>           One per full second
+    Line digests are one byte per line, folded from the line's hash. The
+    rest of the last second of audio isn't hashed, rendering threaded the
+    emulation runs a frame ahead of the frames returned.
+*/
+
+#define MAX_LINE 1024
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+typedef struct {
+    uint32_t hash;
+    uint8_t lines[MOOBOY_HEIGHT];
+} frame_t;
+
+typedef struct {
+    char rom[MAX_LINE];
+    int frames;
+    fixture_script_t script;
+    char header[16 * MAX_LINE]; // Lines before the hashes, kept on update
+
+    frame_t *golden_frames;
+    uint32_t *golden_audio;
+    int num_golden_audio;
+} golden_t;
+
+typedef struct {
+    frame_t *frames;
+    uint32_t *audio;
+    int num_audio;
+} result_t;
+
+static const char *MODE_NAMES[3] = {"immediate", "deferred", "threaded"};
+
+static FILE *report;
+
+static uint32_t fnv(uint32_t hash, const uint8_t *data, size_t size) {
+    size_t b;
+
+    for(b = 0; b < size; b++) {
+        hash = (hash ^ data[b]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static void hash_frame(frame_t *frame) {
+    uint16_t pixels[MOOBOY_WIDTH * MOOBOY_HEIGHT];
+    int ly;
+
+    mooboy_framebuffer(pixels);
+    frame->hash = FNV_BASIS;
+    for(ly = 0; ly < MOOBOY_HEIGHT; ly++) {
+        const uint8_t *line = (const uint8_t*)&pixels[ly * MOOBOY_WIDTH];
+        uint32_t hash = fnv(FNV_BASIS, line, MOOBOY_WIDTH * sizeof(*pixels));
+
+        frame->hash = fnv(frame->hash, line, MOOBOY_WIDTH * sizeof(*pixels));
+        frame->lines[ly] = hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24);
+    }
+}
+
+static int run(golden_t *g, const uint8_t *rom, size_t size, int mode, result_t *result) {
+    int16_t samples[1024 * 2];
+    uint32_t audio_hash = FNV_BASIS;
+    int second_samples = 0;
+    int f, n;
+
+    memset(result, 0x00, sizeof(*result));
+    result->frames = calloc(g->frames, sizeof(*result->frames));
+
+    mooboy_init();
+    mooboy_set_render_mode(mode);
+    if(!mooboy_load_rom(rom, size)) {
+        fprintf(stderr, "%s\n", mooboy_error());
+        mooboy_close();
+        return 0;
+    }
+
+    fixture_script_rewind(&g->script);
+    for(f = 0; f < g->frames; f++) {
+        fixture_script_apply(&g->script, f);
+        if(mooboy_run_frames(1) == 0) {
+            fprintf(stderr, "Stopped after %d frames: %s\n", f, mooboy_error() != NULL ? mooboy_error() : "Not running");
+            mooboy_close();
+            return 0;
+        }
+        hash_frame(&result->frames[f]);
+
+        while((n = mooboy_audio(samples, 1024)) > 0) {
+            int s;
+
+            for(s = 0; s < n; s++) {
+                audio_hash = fnv(audio_hash, (const uint8_t*)&samples[s * 2], 2 * sizeof(*samples));
+                if(++second_samples == mooboy_sound_freq()) {
+                    result->audio = realloc(result->audio, sizeof(*result->audio) * (result->num_audio + 1));
+                    result->audio[result->num_audio++] = audio_hash;
+                    audio_hash = FNV_BASIS;
+                    second_samples = 0;
+                }
+            }
+        }
+    }
+
+    mooboy_close();
+    return 1;
+}
+
+static void free_result(result_t *result) {
+    free(result->frames);
+    free(result->audio);
+}
+
+static int parse_hex(const char *hex, uint8_t *dst, int size) {
+    int b;
+    unsigned byte;
+
+    for(b = 0; b < size; b++) {
+        if(sscanf(&hex[b * 2], "%2x", &byte) != 1) {
+            return 0;
+        }
+        dst[b] = byte;
+    }
+    return 1;
+}
+
+static int parse_line(golden_t *g, char *line) {
+    char hex[MAX_LINE];
+    unsigned hash;
+    int n;
+
+    if(strncmp(line, "frame ", 6) == 0) {
+        if(g->golden_frames == NULL) {
+            g->golden_frames = calloc(g->frames, sizeof(*g->golden_frames));
+        }
+        if(sscanf(line, "frame %d %x %1023s", &n, &hash, hex) != 3 || n < 0 || n >= g->frames ||
+           strlen(hex) != MOOBOY_HEIGHT * 2 || !parse_hex(hex, g->golden_frames[n].lines, MOOBOY_HEIGHT)) {
+            return 0;
+        }
+        g->golden_frames[n].hash = hash;
+        return 1;
+    }
+    if(strncmp(line, "audio ", 6) == 0) {
+        if(sscanf(line, "audio %d %x", &n, &hash) != 2 || n != g->num_golden_audio) {
+            return 0;
+        }
+        g->golden_audio = realloc(g->golden_audio, sizeof(*g->golden_audio) * (n + 1));
+        g->golden_audio[g->num_golden_audio++] = hash;
+        return 1;
+    }
+
+    if(strlen(g->header) + strlen(line) + 2 > sizeof(g->header)) {
+        return 0;
+    }
+    strcat(g->header, line);
+    strcat(g->header, "\n");
+
+    if(line[0] == '#' || line[0] == '\0') {
+        return 1;
+    }
+    if(strncmp(line, "rom ", 4) == 0) {
+        snprintf(g->rom, sizeof(g->rom), "%s", line + 4);
+        return 1;
+    }
+    if(strncmp(line, "frames ", 7) == 0) {
+        return g->golden_frames == NULL && sscanf(line, "frames %d", &g->frames) == 1 && g->frames > 0;
+    }
+    if(strncmp(line, "input ", 6) == 0) {
+        return fixture_script_add(&g->script, line + 6);
+    }
+
+    return 0;
+}
+
+static int load_golden(golden_t *g, const char *path) {
+    FILE *file;
+    char line[MAX_LINE];
+    int number = 0;
+
+    memset(g, 0x00, sizeof(*g));
+    fixture_script_init(&g->script);
+
+    file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open '%s'\n", path);
+        return 0;
+    }
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(!parse_line(g, line)) {
+            fprintf(stderr, "%s:%d: Invalid line '%s'\n", path, number, line);
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+
+    if(g->rom[0] == '\0' || g->frames == 0) {
+        fprintf(stderr, "%s: No rom or frames\n", path);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void free_golden(golden_t *g) {
+    fixture_script_free(&g->script);
+    free(g->golden_frames);
+    free(g->golden_audio);
+}
+
+static uint8_t *load_rom(const golden_t *g, const char *path, size_t *size) {
+    char rom[2 * MAX_LINE];
+    const char *slash = strrchr(path, '/');
+
+    if(strncmp(g->rom, FIXTURE_SYNTH_PREFIX, strlen(FIXTURE_SYNTH_PREFIX)) == 0 || g->rom[0] == '/' || slash == NULL) {
+        return fixture_load_rom(g->rom, size);
+    }
+
+    snprintf(rom, sizeof(rom), "%.*s/%s", (int)(slash - path), path, g->rom);
+    return fixture_load_rom(rom, size);
+}
+
+static int write_golden(const golden_t *g, const char *path, const result_t *result) {
+    FILE *file;
+    int f, l;
+
+    file = fopen(path, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to write '%s'\n", path);
+        return 0;
+    }
+
+    fputs(g->header, file);
+    for(f = 0; f < g->frames; f++) {
+        fprintf(file, "frame %d %.8x ", f, result->frames[f].hash);
+        for(l = 0; l < MOOBOY_HEIGHT; l++) {
+            fprintf(file, "%.2x", result->frames[f].lines[l]);
+        }
+        fputc('\n', file);
+    }
+    for(f = 0; f < result->num_audio; f++) {
+        fprintf(file, "audio %d %.8x\n", f, result->audio[f]);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+// Prints what differs, returns 1 if nothing does
+static int compare(const golden_t *g, const char *path, int mode, const result_t *result) {
+    int f, l, s;
+
+    for(f = 0; f < g->frames && result->frames[f].hash == g->golden_frames[f].hash; f++) {}
+    for(s = 0; s < result->num_audio && s < g->num_golden_audio && result->audio[s] == g->golden_audio[s]; s++) {}
+
+    if(f == g->frames && s == result->num_audio && s == g->num_golden_audio) {
+        fprintf(report, "%s [%s]: ok\n", path, MODE_NAMES[mode]);
+        return 1;
+    }
+
+    fprintf(report, "%s [%s]: FAILED", path, MODE_NAMES[mode]);
+    if(f < g->frames) {
+        for(l = 0; l < MOOBOY_HEIGHT && result->frames[f].lines[l] == g->golden_frames[f].lines[l]; l++) {}
+        if(l < MOOBOY_HEIGHT) {
+            fprintf(report, ", frame %d differs from line %d", f, l);
+        }
+        else {
+            fprintf(report, ", frame %d differs", f);
+        }
+    }
+    if(s < result->num_audio || s < g->num_golden_audio) {
+        fprintf(report, ", audio differs from second %d", s);
+    }
+    fprintf(report, "\n");
+
+    return 0;
+}
+
+static int check(const char *path, const char *modes, int update) {
+    golden_t g;
+    result_t result;
+    uint8_t *rom;
+    size_t size;
+    const char *m;
+    int ok = 1;
+
+    if(!load_golden(&g, path)) {
+        free_golden(&g);
+        return 0;
+    }
+    rom = load_rom(&g, path, &size);
+    if(rom == NULL) {
+        free_golden(&g);
+        return 0;
+    }
+
+    if(update) {
+        ok = run(&g, rom, size, MOOBOY_RENDER_IMMEDIATE, &result) && write_golden(&g, path, &result);
+        if(ok) {
+            fprintf(report, "%s: updated\n", path);
+        }
+        free_result(&result);
+    }
+    else if(g.golden_frames == NULL) {
+        fprintf(report, "%s: FAILED, no hashes, run with -u to record them\n", path);
+        ok = 0;
+    }
+    else {
+        for(m = modes; *m != '\0'; m++) {
+            int mode = *m - '0';
+
+            if(mode < 0 || mode > 2) {
+                continue;
+            }
+            if(!run(&g, rom, size, mode, &result)) {
+                fprintf(report, "%s [%s]: FAILED to run\n", path, MODE_NAMES[mode]);
+                ok = 0;
+            }
+            else {
+                ok = compare(&g, path, mode, &result) && ok;
+            }
+            free_result(&result);
+        }
+    }
+
+    free(rom);
+    free_golden(&g);
+    return ok;
+}
+
+static int is_golden(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext != NULL && strcmp(ext, ".golden") == 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const*)a, *(char * const*)b);
+}
+
+// Checks a golden file or all golden files of a directory in order
+static int check_path(const char *path, const char *modes, int update) {
+    struct stat st;
+    DIR *dir;
+    struct dirent *entry;
+    char **names = NULL;
+    int num_names = 0, n, ok = 1;
+
+    if(stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return check(path, modes, update);
+    }
+
+    dir = opendir(path);
+    if(dir == NULL) {
+        fprintf(stderr, "Failed to open directory '%s'\n", path);
+        return 0;
+    }
+    while((entry = readdir(dir)) != NULL) {
+        if(is_golden(entry->d_name)) {
+            names = realloc(names, sizeof(*names) * (num_names + 1));
+            names[num_names] = malloc(strlen(path) + strlen(entry->d_name) + 2);
+            sprintf(names[num_names], "%s/%s", path, entry->d_name);
+            num_names++;
+        }
+    }
+    closedir(dir);
+
+    qsort(names, num_names, sizeof(*names), compare_names);
+    for(n = 0; n < num_names; n++) {
+        ok = check(names[n], modes, update) && ok;
+        free(names[n]);
+    }
+    free(names);
+
+    return ok;
+}
+
+// A golden file without hashes for rom, to be recorded with -u
+static int create(const char *path, const char *rom, int frames, const char *script_path) {
+    FILE *file, *script;
+    char line[MAX_LINE];
+
+    file = fopen(path, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to write '%s'\n", path);
+        return 0;
+    }
+
+    fprintf(file, "rom %s\nframes %d\n", rom, frames);
+    if(script_path != NULL) {
+        script = fopen(script_path, "r");
+        if(script == NULL) {
+            fprintf(stderr, "Failed to open input script '%s'\n", script_path);
+            fclose(file);
+            return 0;
+        }
+        while(fgets(line, sizeof(line), script) != NULL) {
+            if(line[0] != '#' && line[strspn(line, " \t\r\n")] != '\0') {
+                fprintf(file, "input %s", line);
+            }
+        }
+        fclose(script);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-u] [-m render modes, e.g. 012] <golden file or directory>...\n"
+                    "       %s -c <rom or synth:workload> [-n frames] [-i input script] <golden file>\n", name, name);
+}
+
+int main(int argc, char **argv) {
+    const char *modes = "012";
+    const char *create_rom = NULL, *script_path = NULL;
+    int update = 0, frames = 600;
+    int opt, ok = 1;
+
+    while((opt = getopt(argc, argv, "um:c:n:i:")) != -1) {
+        switch(opt) {
+            case 'u': update = 1; break;
+            case 'm': modes = optarg; break;
+            case 'c': create_rom = optarg; break;
+            case 'n': frames = atoi(optarg); break;
+            case 'i': script_path = optarg; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if(optind >= argc || (create_rom != NULL && (optind != argc - 1 || frames < 1))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(create_rom != NULL) {
+        if(!create(argv[optind], create_rom, frames, script_path)) {
+            return EXIT_FAILURE;
+        }
+        update = 1;
+    }
+
+    // Keep stdout for the report
+    fflush(stdout);
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    for(; optind < argc; optind++) {
+        ok = check_path(argv[optind], modes, update) && ok;
+    }
+
+    fclose(report);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "lib/mooboy.h"
+#include "util/profile.h"
+#include "bench/fixture.h"
+
+/*
+    Runs a ROM headless and unthrottled for a fixed number of frames,
+    repeatedly, with input from a script, and reports host time per frame,
+    emulated clock rate, instructions per second and the time spent in each
+    profile zone as one JSON object on stdout.
+
+    Every run starts from a fresh emulator, so all runs emulate exactly the
+    same and only the host's timing varies. Values are reported as median,
+    10th and 90th percentile over the runs, frame times additionally as
+    percentiles over the frames of all runs.
+*/
+
+typedef struct {
+    double ns_per_frame;
+    double mhz;
+    double instructions_per_sec;
+    double zone_ns_per_frame[PROFILE_NUM_ZONES];
+} run_t;
+
+static fixture_script_t script;
+
+static uint32_t pixels[MOOBOY_WIDTH * MOOBOY_HEIGHT];
+
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// xRGB8888, so the video zone does the work a frontend's conversion would
+static void convert(const uint16_t *line, void *dst) {
+    uint32_t *out = dst;
+    int x;
+
+    for(x = 0; x < MOOBOY_WIDTH; x++) {
+        uint16_t c = line[x];
+        out[x] = ((c & 0x1F) << 19) | (((c >> 5) & 0x1F) << 11) | (((c >> 10) & 0x1F) << 3);
+    }
+}
+
+static int run(const uint8_t *rom, size_t size, int frames, run_t *result, long long *frame_ns, uint32_t *hash) {
+    int16_t audio[1024 * 2];
+    long long start, t, ns;
+    u64 ticks;
+    int f, z;
+
+    mooboy_init();
+    if(!mooboy_load_rom(rom, size)) {
+        fprintf(stderr, "%s\n", mooboy_error());
+        mooboy_close();
+        return 0;
+    }
+    mooboy_set_output(pixels, sizeof(*pixels) * MOOBOY_WIDTH, convert);
+
+    fixture_script_rewind(&script);
+    profile_reset();
+    start = t = now();
+    for(f = 0; f < frames; f++) {
+        long long next;
+
+        fixture_script_apply(&script, f);
+        if(mooboy_run_frames(1) == 0) {
+            break;
+        }
+        while(mooboy_audio(audio, 1024) > 0) {}
+
+        next = now();
+        frame_ns[f] = next - t;
+        t = next;
+    }
+    profile_sync();
+    ns = t - start;
+
+    if(f < frames) {
+        fprintf(stderr, "Stopped after %d frames: %s\n", f, mooboy_error() != NULL ? mooboy_error() : "Not running");
+        mooboy_close();
+        return 0;
+    }
+
+    // Zone ticks are TSC ticks on x86, calibrated against the run's wall time
+    for(ticks = 0, z = 0; z < PROFILE_NUM_ZONES; z++) {
+        ticks += profile.ticks[z];
+    }
+    for(z = 0; z < PROFILE_NUM_ZONES; z++) {
+        result->zone_ns_per_frame[z] = ticks > 0 ? (double)profile.ticks[z] / ticks * ns / frames : 0.0;
+    }
+    result->ns_per_frame = (double)ns / frames;
+    result->mhz = mooboy_cycles() * 4 / (ns / 1e9) / 1e6;
+    result->instructions_per_sec = profile.instructions / (ns / 1e9);
+
+    *hash = mooboy_framebuffer_hash();
+
+    mooboy_close();
+    return 1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_lls(const void *a, const void *b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank on sorted values
+static double percentile(const double *sorted, int n, int p) {
+    return sorted[(n - 1) * p / 100];
+}
+
+// Prints median, p10 and p90 of the double at offset in each run
+static void print_stat(const char *name, const run_t *runs, int num_runs, size_t offset) {
+    double *values = malloc(sizeof(*values) * num_runs);
+    int r;
+
+    for(r = 0; r < num_runs; r++) {
+        values[r] = *(const double*)((const char*)&runs[r] + offset);
+    }
+    qsort(values, num_runs, sizeof(*values), compare_doubles);
+
+    printf("\"%s\": {\"median\": %.1f, \"p10\": %.1f, \"p90\": %.1f}", name,
+           percentile(values, num_runs, 50), percentile(values, num_runs, 10), percentile(values, num_runs, 90));
+
+    free(values);
+}
+
+static void print_string(const char *str) {
+    const char *c;
+
+    putchar('"');
+    for(c = str; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        }
+        else if((unsigned char)*c < 0x20) {
+            printf("\\u%.4x", *c);
+        }
+        else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n frames] [-r runs] [-w warmup runs] [-i input script] <rom or synth:workload>\n", name);
+}
+
+int main(int argc, char **argv) {
+    int frames = 3600, num_runs = 10, num_warmups = 1;
+    const char *script_path = NULL;
+    uint8_t *rom;
+    size_t size;
+    run_t *runs;
+    long long *frame_ns;
+    uint32_t hash, first_hash = 0;
+    int deterministic = 1;
+    int opt, r, z, n;
+
+    while((opt = getopt(argc, argv, "n:r:w:i:")) != -1) {
+        switch(opt) {
+            case 'n': frames = atoi(optarg); break;
+            case 'r': num_runs = atoi(optarg); break;
+            case 'w': num_warmups = atoi(optarg); break;
+            case 'i': script_path = optarg; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if(optind != argc - 1 || frames < 1 || num_runs < 1 || num_warmups < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    fixture_script_init(&script);
+    if(script_path != NULL && !fixture_script_load(&script, script_path)) {
+        return EXIT_FAILURE;
+    }
+
+    rom = fixture_load_rom(argv[optind], &size);
+    if(rom == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    // Keep stdout for the report
+    fflush(stdout);
+    r = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    runs = malloc(sizeof(*runs) * num_runs);
+    frame_ns = malloc(sizeof(*frame_ns) * frames * num_runs);
+
+    for(n = 0; n < num_warmups + num_runs; n++) {
+        int measured = n - num_warmups;
+
+        if(!run(rom, size, frames, &runs[measured > 0 ? measured : 0], &frame_ns[(measured > 0 ? measured : 0) * frames], &hash)) {
+            return EXIT_FAILURE;
+        }
+        if(n == 0) {
+            first_hash = hash;
+        }
+        deterministic = deterministic && hash == first_hash;
+    }
+
+    fflush(stdout);
+    dup2(r, STDOUT_FILENO);
+    close(r);
+
+    qsort(frame_ns, frames * num_runs, sizeof(*frame_ns), compare_lls);
+    n = frames * num_runs;
+
+    printf("{\"rom\": ");
+    print_string(argv[optind]);
+    printf(", \"frames\": %d, \"runs\": %d, \"hash\": \"%.8x\", \"deterministic\": %s, ",
+           frames, num_runs, first_hash, deterministic ? "true" : "false");
+    print_stat("ns_per_frame", runs, num_runs, offsetof(run_t, ns_per_frame));
+    printf(", ");
+    print_stat("mhz", runs, num_runs, offsetof(run_t, mhz));
+    printf(", ");
+    print_stat("instructions_per_sec", runs, num_runs, offsetof(run_t, instructions_per_sec));
+    printf(", \"zones_ns_per_frame\": {");
+    for(z = 0; z < PROFILE_NUM_ZONES; z++) {
+        print_stat(PROFILE_ZONE_NAMES[z], runs, num_runs, offsetof(run_t, zone_ns_per_frame[z]));
+        printf(z + 1 < PROFILE_NUM_ZONES ? ", " : "}");
+    }
+    printf(", \"frame_ns\": {\"p50\": %lld, \"p95\": %lld, \"p99\": %lld}}\n",
+           frame_ns[(n - 1) * 50 / 100], frame_ns[(n - 1) * 95 / 100], frame_ns[(n - 1) * 99 / 100]);
+
+    free(frame_ns);
+    free(runs);
+    free(rom);
+    fixture_script_free(&script);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,536 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "lib/mooboy.h"
+#include "romgen/romgen.h"
+#include "core/moo.h"
+#include "core/cpu.h"
+#include "core/ops.h"
+#include "core/mem.h"
+#include "core/hw.h"
+#include "core/lcd.h"
+#include "core/render.h"
+#include "core/sound.h"
+#include "util/state.h"
+#include "sys/sys.h"
+
+/*
+    Nanoseconds per call of the core's hot functions, each in isolation on
+    an emulator that ran a synthetic ROM (see romgen) for a while, so
+    memory map, scheduler, LCD and APU are in a realistic state. Every
+    value is the median of several timed batches, a batch is sized to run
+    for at least MIN_BATCH_NS. Calls that schedule, render or mix as a
+    side effect (memory accesses step the scheduler) include that work.
+    Usage: mooboy-microbench [function filter]
+*/
+
+#define MIN_BATCH_NS 20000000LL
+#define BATCHES 5
+
+#define BUF_CB   0xC000 // CB opcodes, executed from here
+#define BUF_ARGS 0xC100 // Operands: jp/call target BUF_ARGS, jr +0, immediates 0
+#define BUF_HL   0xC200 // What (hl), (bc) and (de) point to
+
+static const char *filter = NULL;
+static volatile u32 sink;
+static FILE *report;
+
+static uint8_t *rom;
+static size_t rom_size;
+
+// The variant's parameters
+static const u16 *addresses;
+static const u8 *ops;
+static int num_ops;
+
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void measure(const char *function, const char *variant, void (*run)(int n)) {
+    double ns[BATCHES];
+    long long t;
+    int n, b;
+
+    for(n = 1000;; n *= 2) {
+        t = now();
+        run(n);
+        if(now() - t >= MIN_BATCH_NS) {
+            break;
+        }
+    }
+    for(b = 0; b < BATCHES; b++) {
+        t = now();
+        run(n);
+        ns[b] = (double)(now() - t) / n;
+    }
+    qsort(ns, BATCHES, sizeof(*ns), compare_doubles);
+
+    fprintf(stderr, "%s %s\n", function, variant);
+    fprintf(report, "%s,%s,%.2f\n", function, variant, ns[BATCHES / 2]);
+    fflush(report);
+}
+
+static int selected(const char *function) {
+    return filter == NULL || strstr(function, filter) != NULL;
+}
+
+// A fresh emulator that ran workload for frames frames
+static void boot(int workload, int frames) {
+    free(rom);
+    mooboy_close();
+    mooboy_init();
+
+    rom = romgen_build(workload, &rom_size);
+    if(!mooboy_load_rom(rom, rom_size)) {
+        fprintf(stderr, "%s\n", mooboy_error());
+        exit(EXIT_FAILURE);
+    }
+    mooboy_run_frames(frames);
+}
+
+/*
+    Memory
+*/
+static const u16 ROM0[] = {0x0150, 0x0151, 0x0152, 0x0153};
+static const u16 ROMX[] = {0x4000, 0x4001, 0x4002, 0x4003};
+static const u16 VRAM[] = {0x8000, 0x8001, 0x9800, 0x9801};
+static const u16 SRAM[] = {0xA000, 0xA001, 0xA002, 0xA003};
+static const u16 WRAM0[] = {0xC000, 0xC001, 0xC002, 0xC003};
+static const u16 WRAMX[] = {0xD000, 0xD001, 0xD002, 0xD003};
+static const u16 ECHO[] = {0xE000, 0xE001, 0xF000, 0xF001};
+static const u16 OAM[] = {0xFE00, 0xFE01, 0xFE02, 0xFE03};
+static const u16 IO[] = {0xFF40, 0xFF42, 0xFF43, 0xFF47};
+static const u16 HRAM[] = {0xFF80, 0xFF81, 0xFF82, 0xFF83};
+static const u16 IE[] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+static const u16 MBC[] = {0x2000, 0x2000, 0x2000, 0x2000};
+
+static const struct {
+    const char *name;
+    const u16 *addresses;
+    int write;
+} regions[] = {
+    {"rom0", ROM0, 0}, {"romx", ROMX, 0}, {"vram", VRAM, 1}, {"sram", SRAM, 1}, {"wram0", WRAM0, 1},
+    {"wramx", WRAMX, 1}, {"echo", ECHO, 1}, {"oam", OAM, 1}, {"io", IO, 1}, {"hram", HRAM, 1}, {"ie", IE, 1},
+    {"mbc", MBC, 1}
+};
+
+static void run_read(int n) {
+    u32 sum = 0;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        sum += mem_read_byte(addresses[i & 3]);
+    }
+    sink = sum;
+}
+
+// Values 1-31, so bank switches stay within the ROM
+static void run_write(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        mem_write_byte(addresses[i & 3], (i >> 2 & 0x1F) | 0x01);
+    }
+}
+
+static void bench_mem() {
+    int r;
+
+    boot(ROMGEN_MBC, 30);
+    mem_write_byte(0x0000, 0x0A);
+
+    if(selected("mem_read_byte")) {
+        for(r = 0; r < sizeof(regions)/sizeof(*regions); r++) {
+            if(regions[r].addresses != MBC) {
+                addresses = regions[r].addresses;
+                measure("mem_read_byte", regions[r].name, run_read);
+            }
+        }
+    }
+    if(selected("mem_write_byte")) {
+        for(r = 0; r < sizeof(regions)/sizeof(*regions); r++) {
+            if(regions[r].write) {
+                addresses = regions[r].addresses;
+                measure("mem_write_byte", regions[r].name, run_write);
+            }
+        }
+    }
+}
+
+/*
+    CPU
+*/
+static int is_ld_r_r(u8 op) {
+    return op >= 0x40 && op < 0x80 && (op & 7) != 6 && (op >> 3 & 7) != 6;
+}
+
+// ld r,(hl) and ld (hl),r, not into h or l, so hl stays put
+static int is_ld_hl(u8 op) {
+    return op >= 0x40 && op < 0x80 && op != 0x76 && ((op & 7) == 6 || (op >> 3 & 7) == 6) && op != 0x66 && op != 0x6E;
+}
+
+static int is_alu_r(u8 op) {
+    return op >= 0x80 && op < 0xC0 && (op & 7) != 6;
+}
+
+static int is_alu_hl(u8 op) {
+    return op >= 0x80 && op < 0xC0 && (op & 7) == 6;
+}
+
+static int is_alu_n(u8 op) {
+    return op >= 0xC0 && (op & 7) == 6;
+}
+
+static int is_inc_dec_r(u8 op) {
+    return op < 0x40 && ((op & 7) == 4 || (op & 7) == 5) && op != 0x34 && op != 0x35 && op != 0x24 && op != 0x25 && op != 0x2C && op != 0x2D;
+}
+
+static int is_word(u8 op) {
+    return op == 0x03 || op == 0x0B || op == 0x13 || op == 0x1B || op == 0x09 || op == 0x19 || op == 0x29 || op == 0x39;
+}
+
+static int is_ld_r_n(u8 op) {
+    return op == 0x06 || op == 0x0E || op == 0x16 || op == 0x1E || op == 0x3E;
+}
+
+static int is_rotate_a(u8 op) {
+    return op == 0x07 || op == 0x0F || op == 0x17 || op == 0x1F || op == 0x27 || op == 0x2F || op == 0x37 || op == 0x3F;
+}
+
+static int is_jump(u8 op) {
+    return op == 0x18 || op == 0x20 || op == 0x28 || op == 0x30 || op == 0x38 || op == 0xC3 || op == 0xC2 || op == 0xCA;
+}
+
+static int is_cb_shift_r(u8 op) {
+    return op < 0x40 && (op & 7) != 6;
+}
+
+static int is_cb_bit_r(u8 op) {
+    return op >= 0x40 && (op & 7) != 6;
+}
+
+static int is_cb_hl(u8 op) {
+    return (op & 7) == 6;
+}
+
+static const struct {
+    const char *name;
+    int (*filter)(u8 op);
+    int cb;
+} op_classes[] = {
+    {"ld_r_r", is_ld_r_r, 0}, {"ld_hl", is_ld_hl, 0}, {"ld_r_n", is_ld_r_n, 0},
+    {"alu_r", is_alu_r, 0}, {"alu_hl", is_alu_hl, 0}, {"alu_n", is_alu_n, 0},
+    {"inc_dec_r", is_inc_dec_r, 0}, {"word", is_word, 0}, {"rotate_a", is_rotate_a, 0}, {"jump", is_jump, 0},
+    {"cb_shift_r", is_cb_shift_r, 1}, {"cb_bit_r", is_cb_bit_r, 1}, {"cb_hl", is_cb_hl, 1}
+};
+
+static void reset_registers() {
+    AF = 0x01B0;
+    BC = BUF_HL;
+    DE = BUF_HL;
+    HL = BUF_HL;
+    SP = 0xDFF0;
+}
+
+static void run_ops(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        PC = BUF_ARGS;
+        cpu.op = ops[i % num_ops];
+        op_exec();
+    }
+}
+
+static void run_cb_ops(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        PC = BUF_CB + i % num_ops;
+        cpu.op = 0xCB;
+        op_exec();
+    }
+}
+
+// Pairs of push/pop and call/ret, per op
+static void run_stack_ops(int n) {
+    int i;
+
+    for(i = 0; i < n; i += 2) {
+        PC = BUF_ARGS;
+        cpu.op = ops[i % num_ops];
+        op_exec();
+        cpu.op = ops[i % num_ops + 1];
+        op_exec();
+    }
+}
+
+static void bench_cpu() {
+    static const u8 stack_ops[] = {0xC5, 0xC1, 0xD5, 0xD1, 0xE5, 0xE1, 0xF5, 0xF1, 0xCD, 0xC9};
+    u8 class_ops[256];
+    int c, op;
+
+    if(!selected("op_exec")) {
+        return;
+    }
+
+    boot(ROMGEN_ALU, 30);
+    mem_write_byte(BUF_ARGS + 0, BUF_ARGS & 0xFF);
+    mem_write_byte(BUF_ARGS + 1, BUF_ARGS >> 8);
+    ops = class_ops;
+
+    for(c = 0; c < sizeof(op_classes)/sizeof(*op_classes); c++) {
+        for(num_ops = 0, op = 0; op < 256; op++) {
+            if(op_classes[c].filter(op)) {
+                class_ops[num_ops++] = op;
+                if(op_classes[c].cb) {
+                    mem_write_byte(BUF_CB + num_ops - 1, op);
+                }
+            }
+        }
+
+        reset_registers();
+        measure("op_exec", op_classes[c].name, op_classes[c].cb ? run_cb_ops : run_ops);
+    }
+
+    ops = stack_ops;
+    num_ops = sizeof(stack_ops);
+    reset_registers();
+    measure("op_exec", "stack", run_stack_ops);
+}
+
+/*
+    Scheduler
+*/
+static hw_event_t dummy_event;
+
+static void dummy(int mcs) {
+}
+
+// Instruction lengths in M-cycles, every event the ROM keeps busy is due eventually
+static void run_hw_step(int n) {
+    static const int mcs[8] = {1, 2, 3, 1, 2, 4, 1, 3};
+    int i;
+
+    for(i = 0; i < n; i++) {
+        hw_step(mcs[i & 7]);
+        sys.sound_buf_start = sys.sound_buf_end;
+    }
+}
+
+// Schedule and unschedule, into the queue of the ROM's events
+static void run_hw_schedule(int n) {
+    static const int mcs[4] = {4, 114, 1000, 17556};
+    int i;
+
+    for(i = 0; i < n; i += 2) {
+        hw_schedule(&dummy_event, mcs[i / 2 & 3]);
+        hw_unschedule(&dummy_event);
+    }
+}
+
+static void bench_hw() {
+    memset(&dummy_event, 0x00, sizeof(dummy_event));
+    dummy_event.callback = dummy;
+
+    if(selected("hw_step")) {
+        boot(ROMGEN_RASTER, 30);
+        measure("hw_step", "raster", run_hw_step);
+        boot(ROMGEN_APU, 30);
+        measure("hw_step", "apu", run_hw_step);
+    }
+    if(selected("hw_schedule")) {
+        boot(ROMGEN_APU, 30);
+        measure("hw_schedule", "schedule+unschedule", run_hw_schedule);
+    }
+}
+
+/*
+    Rendering, over all lines of the sprites ROM's last OAM table
+*/
+static void run_render_line(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        lcd.render.ly = i % 144;
+        render_line(&lcd.render, lcd.working_fb);
+    }
+}
+
+static void render_config(const char *variant, u8 c, u8 wx, u8 wy) {
+    lcd.render.c = c;
+    lcd.render.scx = 3;
+    lcd.render.scy = 5;
+    lcd.render.wx = wx;
+    lcd.render.wy = wy;
+    measure("render_line", variant, run_render_line);
+}
+
+static void bench_render() {
+    if(!selected("render_line")) {
+        return;
+    }
+
+    boot(ROMGEN_SPRITES, 30);
+    render_config("bg", 0x91, 0, 0);
+    render_config("bg+window", 0xB1, 87, 0);
+    render_config("bg+obj8x16", 0x97, 0, 0);
+    render_config("bg+obj8x8", 0x93, 0, 0);
+    render_config("bg+window+obj8x16", 0xB7, 87, 0);
+
+    moo.mode = NON_CGB_MODE;
+    lcd_rebuild_palette_maps();
+    render_config("dmg:bg+window+obj8x16", 0xB7, 87, 0);
+    moo.mode = CGB_MODE;
+    lcd_rebuild_palette_maps();
+}
+
+/*
+    APU
+*/
+static void run_sound_mix(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        sound_mix();
+        sys.sound_buf_start = sys.sound_buf_end;
+    }
+}
+
+static void bench_sound() {
+    if(!selected("sound_mix")) {
+        return;
+    }
+
+    boot(ROMGEN_APU, 30);
+    measure("sound_mix", "4-channels", run_sound_mix);
+    boot(ROMGEN_ALU, 30);
+    measure("sound_mix", "off", run_sound_mix);
+}
+
+/*
+    VRAM writes, each changes the byte, so the render caches are updated
+*/
+static void run_vram_write(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        lcd_vram_write(addresses[0] + (i & 0x3FF), i >> 10);
+    }
+}
+
+static void run_vram_write_same(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        u16 adr = addresses[0] + (i & 0x3FF);
+        lcd_vram_write(adr, ram.vrambanks[ram.selected_vrambank][adr - 0x8000]);
+    }
+}
+
+static void bench_vram() {
+    static const u16 tiles[1] = {0x8000};
+    static const u16 map[1] = {0x9800};
+
+    if(!selected("lcd_vram_write")) {
+        return;
+    }
+
+    boot(ROMGEN_SPRITES, 30);
+    addresses = tiles;
+    measure("lcd_vram_write", "tile-data", run_vram_write);
+    addresses = map;
+    measure("lcd_vram_write", "map", run_vram_write);
+    measure("lcd_vram_write", "unchanged", run_vram_write_same);
+
+    mooboy_set_render_mode(MOOBOY_RENDER_DEFERRED);
+    mooboy_run_frames(2);
+    addresses = tiles;
+    measure("lcd_vram_write", "deferred:tile-data", run_vram_write);
+}
+
+/*
+    States, to a temporary file
+*/
+static char state_path[] = "/tmp/mooboy-microbench-XXXXXX";
+
+static void run_state_save(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        state_save(state_path);
+    }
+}
+
+static void run_state_load(int n) {
+    int i;
+
+    for(i = 0; i < n; i++) {
+        state_load(state_path);
+    }
+}
+
+static void bench_state() {
+    int fd;
+
+    if(!selected("state_")) {
+        return;
+    }
+
+    fd = mkstemp(state_path);
+    if(fd < 0) {
+        fprintf(stderr, "Failed to create a temporary file\n");
+        return;
+    }
+    close(fd);
+
+    boot(ROMGEN_MBC, 30);
+    if(selected("state_save")) {
+        measure("state_save", "mbc5", run_state_save);
+    }
+    if(selected("state_load")) {
+        state_save(state_path);
+        measure("state_load", "mbc5", run_state_load);
+    }
+
+    unlink(state_path);
+}
+
+int main(int argc, char **argv) {
+    int out;
+
+    filter = argc > 1 ? argv[1] : NULL;
+
+    // The emulator's chatter goes to stderr
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    report = fdopen(out, "w");
+    fprintf(report, "function,variant,ns_per_op\n");
+
+    mooboy_init();
+
+    bench_mem();
+    bench_cpu();
+    bench_hw();
+    bench_render();
+    bench_sound();
+    bench_vram();
+    bench_state();
+
+    mooboy_close();
+    free(rom);
+    fclose(report);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core/lcd.h"
+#include "util/scale.h"
+
+/*
+    Throughput of the output stage in megapixels (written) per second: the
+    color conversion alone for every output format, with and without color
+    correction, then conversion plus scaling for every integer factor and a
+    few fractional widths.
+    Usage: mooboy-scalebench [frames]
+*/
+
+static const struct {
+    const char *name;
+    int format;
+    int rshift, gshift, bshift;
+    int rloss, gloss, bloss;
+} formats[] = {
+    {"rgb565", SCALE_FORMAT_RGB565, 11, 5, 0, 3, 2, 3},
+    {"xrgb8888", SCALE_FORMAT_XRGB8888, 16, 8, 0, 0, 0, 0},
+    {"bgr555", SCALE_FORMAT_MASKED16, 0, 5, 10, 3, 3, 3},
+    {"xbgr8888", SCALE_FORMAT_MASKED32, 0, 8, 16, 0, 0, 0}
+};
+
+static const struct {
+    const char *name;
+    int width;
+} modes[] = {
+    {"1x", 160}, {"2x", 320}, {"3x", 480}, {"4x", 640}, {"5x", 800}, {"6x", 960},
+    {"full-proportional-480p", 533}, {"streched-800", 800 + 1}, {"streched-1024", 1024}, {"streched-1920", 1920}
+};
+
+static u16 src[LCD_WIDTH * LCD_HEIGHT];
+static u32 dst[2048];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u32 reference_color(int f, u16 c) {
+    u32 r = ((c & 0x1F) << 3) | ((c & 0x1F) >> 2);
+    u32 g = (((c >> 5) & 0x1F) << 3) | (((c >> 5) & 0x1F) >> 2);
+    u32 b = (((c >> 10) & 0x1F) << 3) | (((c >> 10) & 0x1F) >> 2);
+
+    return ((r >> formats[f].rloss) << formats[f].rshift) |
+           ((g >> formats[f].gloss) << formats[f].gshift) |
+           ((b >> formats[f].bloss) << formats[f].bshift);
+}
+
+static int verify(int f, int width) {
+    int ax;
+
+    for(ax = 0; ax < width; ax++) {
+        int x = 0;
+        u32 pixel = scale.bytes_per_pixel == 2 ? ((u16*)dst)[ax] : dst[ax];
+
+        while(((x + 1) * width) / LCD_WIDTH <= ax) {
+            x++;
+        }
+        if(pixel != reference_color(f, src[x])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double run(void (*func)(const u16*, void*), int frames, int width) {
+    double start = now();
+    int f, l;
+
+    for(f = 0; f < frames; f++) {
+        for(l = 0; l < LCD_HEIGHT; l++) {
+            func(&src[l * LCD_WIDTH], dst);
+        }
+    }
+
+    return (double)frames * LCD_HEIGHT * width / (now() - start) / 1e6;
+}
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int f, m, i;
+
+    for(i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        src[i] = rand() & 0x7FFF;
+    }
+
+    printf("stage,format,mode,width,simd,mpixels_per_sec\n");
+
+    for(f = 0; f < sizeof(formats)/sizeof(*formats); f++) {
+        scale_set_format(formats[f].format, formats[f].rshift, formats[f].gshift, formats[f].bshift,
+                         formats[f].rloss, formats[f].gloss, formats[f].bloss);
+        printf("convert,%s,-,%i,%s,%.1f\n", formats[f].name, LCD_WIDTH, scale_simd_name(),
+               run(scale.convert, frames, LCD_WIDTH));
+
+        scale_set_color_correction(1);
+        printf("convert-corrected,%s,-,%i,%s,%.1f\n", formats[f].name, LCD_WIDTH, scale_simd_name(),
+               run(scale.convert, frames, LCD_WIDTH));
+        scale_set_color_correction(0);
+
+        for(m = 0; m < sizeof(modes)/sizeof(*modes); m++) {
+            scale_set_width(modes[m].width);
+
+            scale_line(src, dst);
+            if(!verify(f, modes[m].width)) {
+                fprintf(stderr, "%s/%s: wrong output\n", formats[f].name, modes[m].name);
+                return 1;
+            }
+
+            printf("scale,%s,%s,%i,%s,%.1f\n", formats[f].name, modes[m].name, modes[m].width, scale_simd_name(),
+                   run(scale_line, frames, modes[m].width));
+        }
+    }
+
+    return 0;
+}
@@ -13,13 +13,14 @@
 #include "defines.h"
 #include "timers.h"
 #include "sys/sys.h"
+#include "util/histogram.h"
 
 #ifdef DEBUG
 #include "debug/record.h"
 #include "debug/event.h"
 #endif
 
-cpu_t cpu;
+THREAD_LOCAL cpu_t cpu;
 
 void cpu_reset() {
     if(moo.hw == CGB_HW) {
@@ -52,6 +53,8 @@ void cpu_reset() {
 
 
 u8 cpu_step() {
+    u8 mcs;
+
     ints_handle();
 
 #ifdef DEBUG
@@ -63,8 +66,12 @@ u8 cpu_step() {
     debug_event(event);
 #endif
 
+    HISTOGRAM_OP_BEGIN();
     cpu.op = mem_read_byte(PC++);
-    return op_exec();
+    mcs = op_exec();
+    HISTOGRAM_OP_END(cpu.op, cpu.cb, mcs);
+
+    return mcs;
 }
 
 
@@ -33,7 +33,7 @@ typedef struct {
 } cpu_t;
 
 
-extern cpu_t cpu;
+extern THREAD_LOCAL cpu_t cpu;
 
 void cpu_reset();
 u8 cpu_exec(u8 op);
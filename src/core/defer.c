@@ -0,0 +1,316 @@
+#include "defer.h"
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "lcd.h"
+#include "mem.h"
+#include "render.h"
+
+/*
+    Deferred rendering: Lines are not drawn when the LCD reaches them, only
+    their registers are queued. Writes to VRAM, OAM and the palettes are
+    queued in between, so replaying the queue in order draws every line from
+    exactly the memory it would have been drawn from. The renderer works on a
+    mirror of the video memory, so writes with no line queued before them are
+    applied to the mirror directly.
+
+    The queue is either replayed at VBlank or, if threaded, continuously
+    consumed by a render thread. The core is the only producer, so head and
+    tail are each written by one thread only. Every emulator has its own
+    queue, the render thread is handed the queue of the emulator it serves.
+*/
+
+#define QUEUE_SIZE 0x4000
+#define WAKE_LINES 8
+
+#define QUEUE_LINE    0
+#define QUEUE_VRAM0   1
+#define QUEUE_VRAM1   2
+#define QUEUE_OAM     3
+#define QUEUE_BGP     4
+#define QUEUE_OBP     5
+#define QUEUE_VRAM0_BLOCK 6
+#define QUEUE_VRAM1_BLOCK 7
+#define QUEUE_OAM_BLOCK   8
+
+#define BLOCK_SIZE 16
+
+typedef struct {
+    u8 type;
+    u8 val; // Length of QUEUE_*_BLOCK
+    u16 adr;
+
+    union {
+        // QUEUE_LINE
+        struct {
+            u8 c, ly;
+            u8 scx, scy;
+            u8 wx, wy;
+            lcd_frame_t *frame;
+        };
+
+        // QUEUE_*_BLOCK
+        u8 block[BLOCK_SIZE];
+    };
+} entry_t;
+
+typedef struct {
+    lcd_render_t render;
+    u8 vrambanks[2][0x2000];
+    u8 oam[0xA0];
+    lcd_palettes_t bgp, obp;
+
+    entry_t queue[QUEUE_SIZE];
+    u32 head;
+    u32 tail;
+    u32 frame_end;
+
+    int threaded;
+    int thread_started;
+    int sleeping;
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} defer_t;
+
+// The queue of this thread's emulator, shared with its render thread
+static THREAD_LOCAL defer_t *d = NULL;
+
+static void process(defer_t *d, entry_t *e) {
+    switch(e->type) {
+        case QUEUE_LINE:
+            d->render.c = e->c;
+            d->render.ly = e->ly;
+            d->render.scx = e->scx;
+            d->render.scy = e->scy;
+            d->render.wx = e->wx;
+            d->render.wy = e->wy;
+            render_line(&d->render, e->frame);
+        break;
+        case QUEUE_VRAM0: render_vram_write(&d->render, 0, e->adr, e->val); break;
+        case QUEUE_VRAM1: render_vram_write(&d->render, 1, e->adr, e->val); break;
+        case QUEUE_OAM: render_oam_write(&d->render, e->adr, e->val); break;
+        case QUEUE_BGP: render_palette_write(&d->render, 0, e->adr, e->val); break;
+        case QUEUE_OBP: render_palette_write(&d->render, 1, e->adr, e->val); break;
+        case QUEUE_VRAM0_BLOCK: render_vram_block_write(&d->render, 0, e->adr, e->block, e->val); break;
+        case QUEUE_VRAM1_BLOCK: render_vram_block_write(&d->render, 1, e->adr, e->block, e->val); break;
+        case QUEUE_OAM_BLOCK: render_oam_block_write(&d->render, e->adr, e->block, e->val); break;
+    }
+}
+
+static void replay() {
+    for(; d->tail != d->head; d->tail++) {
+        process(d, &d->queue[d->tail % QUEUE_SIZE]);
+    }
+}
+
+static int has_work(defer_t *d) {
+    return __atomic_load_n(&d->threaded, __ATOMIC_SEQ_CST) &&
+           __atomic_load_n(&d->head, __ATOMIC_SEQ_CST) != d->tail;
+}
+
+static int quitting(defer_t *d) {
+    return __atomic_load_n(&d->quit, __ATOMIC_SEQ_CST);
+}
+
+static void *render_thread(void *arg) {
+    defer_t *d = arg;
+
+    for(;;) {
+        if(!has_work(d)) {
+            pthread_mutex_lock(&d->mutex);
+            __atomic_store_n(&d->sleeping, 1, __ATOMIC_SEQ_CST);
+            while(!has_work(d) && !quitting(d)) {
+                pthread_cond_wait(&d->cond, &d->mutex);
+            }
+            __atomic_store_n(&d->sleeping, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&d->mutex);
+
+            if(quitting(d)) {
+                break;
+            }
+        }
+
+        process(d, &d->queue[d->tail % QUEUE_SIZE]);
+        __atomic_store_n(&d->tail, d->tail + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static void wake() {
+    if(__atomic_load_n(&d->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&d->mutex);
+        pthread_cond_signal(&d->cond);
+        pthread_mutex_unlock(&d->mutex);
+    }
+}
+
+// Waits until everything queued before position pos has been processed
+static void wait_for(u32 pos) {
+    if(d->threaded) {
+        wake();
+        while((s32)(__atomic_load_n(&d->tail, __ATOMIC_ACQUIRE) - pos) < 0) {
+            sched_yield();
+        }
+    }
+    else {
+        replay();
+    }
+}
+
+static entry_t *reserve() {
+    if(d->head - __atomic_load_n(&d->tail, __ATOMIC_ACQUIRE) == QUEUE_SIZE) {
+        wait_for(d->head - QUEUE_SIZE + 1);
+    }
+    return &d->queue[d->head % QUEUE_SIZE];
+}
+
+// The render thread is only woken up for batches of lines, writes are picked up along with them
+static void commit(int wake_thread) {
+    __atomic_store_n(&d->head, d->head + 1, __ATOMIC_SEQ_CST);
+
+    if(d->threaded && wake_thread) {
+        wake();
+    }
+}
+
+static void queue_write(u8 type, u16 adr, u8 val, const u8 *block) {
+    entry_t *e;
+
+    if(!d->threaded && d->head == d->tail) {
+        entry_t direct;
+        direct.type = type;
+        direct.adr = adr;
+        direct.val = val;
+        if(block != NULL) {
+            memcpy(direct.block, block, val);
+        }
+        process(d, &direct);
+        return;
+    }
+
+    e = reserve();
+    e->type = type;
+    e->adr = adr;
+    e->val = val;
+    if(block != NULL) {
+        memcpy(e->block, block, val);
+    }
+    commit(0);
+}
+
+void defer_set_threaded(int on) {
+    if(d == NULL) {
+        d = calloc(1, sizeof(*d));
+        pthread_mutex_init(&d->mutex, NULL);
+        pthread_cond_init(&d->cond, NULL);
+    }
+
+    if(on == d->threaded) {
+        return;
+    }
+
+    defer_flush();
+
+    if(on && !d->thread_started) {
+        d->thread_started = pthread_create(&d->thread, NULL, render_thread, d) == 0;
+        if(!d->thread_started) {
+            return;
+        }
+    }
+    __atomic_store_n(&d->threaded, on, __ATOMIC_SEQ_CST);
+}
+
+// Stops the render thread and releases the queue
+void defer_close() {
+    if(d == NULL) {
+        return;
+    }
+
+    defer_flush();
+
+    if(d->thread_started) {
+        pthread_mutex_lock(&d->mutex);
+        __atomic_store_n(&d->quit, 1, __ATOMIC_SEQ_CST);
+        pthread_cond_signal(&d->cond);
+        pthread_mutex_unlock(&d->mutex);
+        pthread_join(d->thread, NULL);
+    }
+
+    pthread_mutex_destroy(&d->mutex);
+    pthread_cond_destroy(&d->cond);
+    free(d);
+    d = NULL;
+}
+
+void defer_sync() {
+    defer_flush();
+
+    memcpy(d->vrambanks, ram.vrambanks, sizeof(d->vrambanks));
+    memcpy(d->oam, ram.oam, sizeof(d->oam));
+    d->bgp = lcd.bgp;
+    d->obp = lcd.obp;
+
+    render_reset(&d->render, d->vrambanks, d->oam, &d->bgp, &d->obp);
+    d->render.cached_c = lcd.c;
+    d->render.output = d->threaded ? NULL : &lcd.output;
+}
+
+void defer_line() {
+    entry_t *e = reserve();
+
+    e->type = QUEUE_LINE;
+    e->c = lcd.c;
+    e->ly = lcd.ly;
+    e->scx = lcd.scx;
+    e->scy = lcd.scy;
+    e->wx = lcd.wx;
+    e->wy = lcd.wy;
+    e->frame = lcd.working_fb;
+    commit((lcd.ly % WAKE_LINES) == WAKE_LINES - 1);
+}
+
+void defer_flush() {
+    wait_for(d->head);
+}
+
+void defer_end_frame() {
+    d->frame_end = d->head;
+}
+
+void defer_wait_frame() {
+    wait_for(d->frame_end);
+}
+
+void defer_vram_write(u8 bank, u16 vram_adr, u8 val) {
+    queue_write(bank ? QUEUE_VRAM1 : QUEUE_VRAM0, vram_adr, val, NULL);
+}
+
+void defer_vram_block_write(u8 bank, u16 vram_adr, const u8 *src, int len) {
+    int n;
+
+    for(; len > 0; len -= n, vram_adr += n, src += n) {
+        n = min(len, BLOCK_SIZE);
+        queue_write(bank ? QUEUE_VRAM1_BLOCK : QUEUE_VRAM0_BLOCK, vram_adr, n, src);
+    }
+}
+
+void defer_oam_write(u8 oam_adr, u8 val) {
+    queue_write(QUEUE_OAM, oam_adr, val, NULL);
+}
+
+void defer_oam_block_write(u8 oam_adr, const u8 *src, int len) {
+    int n;
+
+    for(; len > 0; len -= n, oam_adr += n, src += n) {
+        n = min(len, BLOCK_SIZE);
+        queue_write(QUEUE_OAM_BLOCK, oam_adr, n, src);
+    }
+}
+
+void defer_palette_write(int obp, u8 s, u8 val) {
+    queue_write(obp ? QUEUE_OBP : QUEUE_BGP, s, val, NULL);
+}
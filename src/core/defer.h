@@ -0,0 +1,20 @@
+#ifndef CORE_DEFER_H
+#define CORE_DEFER_H
+
+#include "defines.h"
+
+void defer_set_threaded(int on);
+void defer_close();
+void defer_sync();
+void defer_line();
+void defer_flush();
+void defer_end_frame();
+void defer_wait_frame();
+
+void defer_vram_write(u8 bank, u16 vram_adr, u8 val);
+void defer_vram_block_write(u8 bank, u16 vram_adr, const u8 *src, int len);
+void defer_oam_write(u8 oam_adr, u8 val);
+void defer_oam_block_write(u8 oam_adr, const u8 *src, int len);
+void defer_palette_write(int obp, u8 s, u8 val);
+
+#endif
@@ -5,10 +5,17 @@
 
 typedef int8_t s8;
 typedef int16_t s16;
+typedef int32_t s32;
 typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
+
+/*
+    Every thread runs its own emulator: All state of an emulator lives in
+    thread local storage, only constant tables are shared.
+*/
+#define THREAD_LOCAL __thread
 
 #define A (cpu.af.b[1])
 #define F (cpu.af.b[0])
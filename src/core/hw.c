@@ -5,14 +5,67 @@
 #include "sound.h"
 #include "timers.h"
 #include "sys/sys.h"
+#include "util/profile.h"
+#include "util/performance.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-#include "sys/sdl/input.h"
 
-hw_t hw;
+THREAD_LOCAL hw_t hw;
+
+const char *HW_EVENT_NAMES[HW_NUM_EVENTS] = {
+    "lcd-mode-0", "lcd-mode-1", "lcd-mode-2", "lcd-mode-3", "vblank_line", "mix", "sweep", "envelopes",
+    "length_counters", "tima", "div", "rtc", "lcd-dma"
+};
+
+/*
+    Scheduler telemetry in performance.scheduler, compiled in with HW_TELEMETRY
+*/
+#ifdef HW_TELEMETRY
+
+static inline unsigned int list_length(hw_event_t *event) {
+    unsigned int length;
+
+    for(length = 0; event != NULL; event = event->next) {
+        length++;
+    }
+    return length;
+}
+
+static inline void telemetry_step(int mcs) {
+    performance_scheduler_counters_t *s = &performance.scheduler_counting;
+
+    s->steps++;
+    s->mcs += mcs;
+    s->peak_queue = max(s->peak_queue, list_length(hw.queue));
+
+    if(s->mcs >= cpu.freq) {
+        performance_scheduler_second();
+    }
+}
+
+static inline performance_event_counters_t *telemetry_event(hw_event_t *event) {
+    return &performance.scheduler_counting.events[event->id];
+}
+
+#define TELEMETRY_STEP(mcs) telemetry_step(mcs)
+#define TELEMETRY_FIRE(event, dist) (telemetry_event(event)->fires++, telemetry_event(event)->lateness += (dist))
+#define TELEMETRY_SCHEDULE(event) (telemetry_event(event)->schedules++, \
+    performance.scheduler_counting.peak_sched = max(performance.scheduler_counting.peak_sched, list_length(hw.sched)))
+#define TELEMETRY_UNSCHEDULE(event) (telemetry_event(event)->unschedules++)
+#define TELEMETRY_DEFER() (performance.scheduler_counting.defers++)
+
+#else
+
+#define TELEMETRY_STEP(mcs)
+#define TELEMETRY_FIRE(event, dist)
+#define TELEMETRY_SCHEDULE(event)
+#define TELEMETRY_UNSCHEDULE(event)
+#define TELEMETRY_DEFER()
+
+#endif
 
 void hw_reset() {
 #ifdef DEBUG
@@ -21,6 +74,7 @@ void hw_reset() {
     lcd.mode_event[2].dbg_queued = 0;
     lcd.mode_event[3].dbg_queued = 0;
     lcd.vblank_line_event.dbg_queued = 0;
+    lcd.dma_event.dbg_queued = 0;
     rtc_event.dbg_queued = 0;
     sound_mix_event.dbg_queued = 0;
     sound_envelopes_event.dbg_queued = 0;
@@ -87,7 +141,10 @@ static void poll_queue(int mcs) {
             assert(hw.queue->dbg_queued);
             hw.queue->dbg_queued = 0;
 #endif
+            TELEMETRY_FIRE(hw.queue, dist);
+            PROFILE_ENTER(PROFILE_EVENTS);
             hw.queue->callback(dist);
+            PROFILE_LEAVE();
             hw.queue = next;
         }
         else {
@@ -109,6 +166,7 @@ void hw_step(int mcs) {
 #endif
 
     schedule();
+    TELEMETRY_STEP(mcs);
     poll_queue(mcs);
 
     sys.invoke_cc += mcs;
@@ -126,6 +184,8 @@ void hw_schedule(hw_event_t *sched, int mcs) {
     sched->mcs = hw.cc + mcs;
     sched->next = hw.sched;
     hw.sched = sched;
+
+    TELEMETRY_SCHEDULE(sched);
 }
 
 static void unschedule_from_queue(hw_event_t **q, hw_event_t *del) {
@@ -150,9 +210,12 @@ void hw_unschedule(hw_event_t *del) {
 
     unschedule_from_queue(&hw.queue, del);
     unschedule_from_queue(&hw.sched, del);
+
+    TELEMETRY_UNSCHEDULE(del);
 }
 
 void hw_defer(hw_cycle_t mcs) {
+    TELEMETRY_DEFER();
     hw.defered += mcs;
 }
 
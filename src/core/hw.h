@@ -5,6 +5,22 @@
 
 typedef u32 hw_cycle_t;
 
+// hw_event_t.id, also what savestates store
+#define HW_EVENT_LCD_MODE_0 0
+#define HW_EVENT_LCD_MODE_1 1
+#define HW_EVENT_LCD_MODE_2 2
+#define HW_EVENT_LCD_MODE_3 3
+#define HW_EVENT_LCD_VBLANK_LINE 4
+#define HW_EVENT_SOUND_MIX 5
+#define HW_EVENT_SOUND_SWEEP 6
+#define HW_EVENT_SOUND_ENVELOPES 7
+#define HW_EVENT_SOUND_LENGTH_COUNTERS 8
+#define HW_EVENT_TIMERS_TIMA 9
+#define HW_EVENT_TIMERS_DIV 10
+#define HW_EVENT_RTC 11
+#define HW_EVENT_LCD_DMA 12
+#define HW_NUM_EVENTS 13
+
 typedef struct hw_event_s {
     void (*callback)(int);
     struct hw_event_s *next;
@@ -22,7 +38,8 @@ typedef struct {
     hw_event_t *queue, *sched;
 } hw_t;
 
-extern hw_t hw;
+extern THREAD_LOCAL hw_t hw;
+extern const char *HW_EVENT_NAMES[HW_NUM_EVENTS];
 
 
 void hw_reset();
@@ -6,6 +6,7 @@
 #include "cpu.h"
 #include "defines.h"
 #include "hw.h"
+#include "util/sampler.h"
 
 static inline void exec_int(u8 i) {
     hw_step(2);
@@ -19,6 +20,7 @@ static inline void exec_int(u8 i) {
     hw_step(2);
 
     PC = 0x40 + (i<<3);
+    SAMPLER_CALL(PC);
 
     hw_step(1);
 }
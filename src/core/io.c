@@ -10,10 +10,13 @@
 #include "defines.h"
 #include "joy.h"
 #include "serial.h"
+#include "util/histogram.h"
 
 u8 io_read(u16 adr) {
     u8 reg = adr & 0x00FF;
 
+    HISTOGRAM_IO_READ(reg);
+
     switch(reg) {
         case 0x00: return joy_read(); break;
 
@@ -85,6 +88,8 @@ u8 io_read(u16 adr) {
 void io_write(u16 adr, u8 val) {
     u8 reg = adr & 0x00FF;
 
+    HISTOGRAM_IO_WRITE(reg);
+
     switch(reg) {
         case 0x00: joy_select_col(val); break;
 
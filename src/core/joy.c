@@ -9,7 +9,7 @@
 
 
 
-joy_t joy;
+THREAD_LOCAL joy_t joy;
 
 void joy_reset() {
     joy.state = 0xFF;
@@ -23,7 +23,7 @@ typedef struct {
     u8 col;
 } joy_t;
 
-extern joy_t joy;
+extern THREAD_LOCAL joy_t joy;
 
 void joy_reset();
 
@@ -9,6 +9,9 @@
 #include "defines.h"
 #include "obj.h"
 #include "maps.h"
+#include "render.h"
+#include "defer.h"
+#include "mbc.h"
 
 #define DUR_MODE_0 (51 * cpu.freq_factor)
 #define DUR_MODE_2 (20 * cpu.freq_factor)
@@ -34,8 +37,13 @@
 #define MAP_COLUMNS 32
 #define MAP_ROWS 32
 
+#define DMG_SHADE(v) ((v) | (v) << 5 | (v) << 10)
 
-lcd_t lcd;
+#define DUR_DMA 160
+#define OAM_SIZE 0xA0
+
+
+THREAD_LOCAL lcd_t lcd;
 
 
 static void unschedule() {
@@ -63,83 +71,187 @@ static void check_coincidence() {
 }
 
 static void swap_fb() {
-    u16 *tmp = lcd.clean_fb;
+    lcd_frame_t *tmp = lcd.clean_fb;
     lcd.clean_fb = lcd.working_fb;
     lcd.working_fb = tmp;
 }
 
-static inline int cgb_priority(int maps_color_id, int maps_priority, int obj_color_id, int obj_priority) {
-    int bg_priority = (lcd.c & LCDC_BG_ENABLE_BIT) && (maps_priority || obj_priority);
-    return (bg_priority && maps_color_id != 0) || obj_color_id == 0;
+static void draw_line() {
+    if(lcd.deferred) {
+        defer_line();
+    }
+    else {
+        lcd.render.c = lcd.c;
+        lcd.render.ly = lcd.ly;
+        lcd.render.scx = lcd.scx;
+        lcd.render.scy = lcd.scy;
+        lcd.render.wx = lcd.wx;
+        lcd.render.wy = lcd.wy;
+        render_line(&lcd.render, lcd.working_fb);
+    }
 }
 
-static inline int dmg_priority(int maps_color_id, int maps_priority, int obj_color_id, int obj_priority) {
-    return (obj_priority && maps_color_id != 0) || obj_color_id == 0;
+/*
+    The render thread draws a frame while the core already runs the next one,
+    so a frame is presented one VBlank late and the core moves on to the
+    third framebuffer in the meantime.
+*/
+static void present_pending() {
+    if(lcd.pending_fb != NULL) {
+        defer_wait_frame();
+        lcd.clean_fb = lcd.pending_fb;
+        lcd.pending_fb = NULL;
+        sys_fb_ready();
+    }
 }
 
-static void draw_line() {
-    u16 obj_scan[160], maps_scan[160];
-    pixel_meta_t obj_meta[160], maps_meta[160];
-    obj_range_t obj_ranges[11];
-    int x, r;
-    u16 *pixel = &lcd.working_fb[lcd.ly * LCD_WIDTH];
-    int (*priority_func)(int, int, int, int);
-    int num_obj_ranges;
-
-    memset(obj_scan, 0x00, sizeof(obj_scan));
-    memset(obj_meta, 0x00, sizeof(obj_meta));
-
-    lcd_scan_maps(maps_scan, maps_meta);
-
-    if(lcd.c & LCDC_OBJ_ENABLE_BIT) {
-        lcd_scan_obj(obj_scan, obj_meta, obj_ranges, &num_obj_ranges);
-
-        priority_func = moo.mode == CGB_MODE ? cgb_priority : dmg_priority;
-
-        for(x = 0, r = 0; r < num_obj_ranges; r++) {
-            memcpy(pixel, &maps_scan[x], obj_ranges[r].diff * sizeof(*pixel));
-            x += obj_ranges[r].diff; assert(x <= 160);
-            pixel += obj_ranges[r].diff;
-
-            for(; x < obj_ranges[r].end; x++, pixel++) {
-                if(priority_func(maps_meta[x].color_id, maps_meta[x].priority, obj_meta[x].color_id, obj_meta[x].priority)) {
-                    *pixel = maps_scan[x];
-                }
-                else {
-                    *pixel = obj_scan[x];
-                }
-            }
+static void queue_frame() {
+    int b;
+
+    defer_end_frame();
+    lcd.pending_fb = lcd.working_fb;
+
+    for(b = 0; b < 3; b++) {
+        if(&lcd.fb[b] != lcd.clean_fb && &lcd.fb[b] != lcd.pending_fb) {
+            lcd.working_fb = &lcd.fb[b];
         }
-        memcpy(pixel, &maps_scan[x], (160-x) * sizeof(*pixel));
-
-//        for(x = 0, r = 0; x < LCD_WIDTH; r++) {
-//            memcpy(pixel, &maps_scan[x], obj_ranges[r].diff * sizeof(*pixel));
-//            x += obj_ranges[r].diff; assert(x <= 160);
-//            pixel += obj_ranges[r].diff;
-//
-//            for(; x < LCD_WIDTH; x++, pixel++) {
-//                if(priority_func(maps_meta[x].color_id, maps_meta[x].priority, obj_meta[x].color_id, obj_meta[x].priority)) {
-//                    *pixel = maps_scan[x];
-//                }
-//                else {
-//                    *pixel = obj_scan[x];
-//                }
-//            }
-//        }
+    }
+}
+
+static void set_render_mode(int mode) {
+    lcd.render_mode = mode;
+    lcd.deferred = mode != SYS_RENDER_IMMEDIATE;
+    defer_set_threaded(mode == SYS_RENDER_THREADED);
+    lcd_render_dirty();
+}
+
+static void select_render_mode() {
+    if(sys.render_mode != lcd.render_mode) {
+        lcd_flush();
+        present_pending();
+        set_render_mode(sys.render_mode);
+    }
+}
+
+static void oam_block_write(const u8 *src) {
+    if(memcmp(ram.oam, src, OAM_SIZE) == 0) {
+        return;
+    }
+
+    if(lcd.deferred) {
+        memcpy(ram.oam, src, OAM_SIZE);
+        defer_oam_block_write(0, src, OAM_SIZE);
     }
     else {
-        memcpy(pixel, maps_scan, 160 * sizeof(*maps_scan));
+        render_oam_block_write(&lcd.render, 0, src, OAM_SIZE);
     }
 }
 
-inline void hdma() {
-    u16 end;
+static inline void oam_write(u8 oam_adr, u8 val) {
+    if(val == ram.oam[oam_adr]) {
+        return;
+    }
 
-    hw_defer(8);
+    if(lcd.deferred) {
+        ram.oam[oam_adr] = val;
+        defer_oam_write(oam_adr, val);
+    }
+    else {
+        render_oam_write(&lcd.render, oam_adr, val);
+    }
+}
+
+static void vram_block_write(u16 vram_adr, const u8 *src, int len) {
+    u8 bank = ram.selected_vrambank;
+
+    if(memcmp(&ram.vrambanks[bank][vram_adr], src, len) == 0) {
+        return;
+    }
+
+    if(lcd.deferred) {
+        memcpy(&ram.vrambanks[bank][vram_adr], src, len);
+        defer_vram_block_write(bank, vram_adr, src, len);
+    }
+    else {
+        render_vram_block_write(&lcd.render, bank, vram_adr, src, len);
+    }
+}
+
+/*
+    Returns the memory at adr if it can be read without side effects and
+    sets *avail to the number of bytes following it in the same region.
+*/
+static const u8 *dma_source(u16 adr, int *avail) {
+#ifdef DEBUG
+    // The memory watches need to see every byte
+#else
+    switch(adr >> 12) {
+        case 0x0: case 0x1: case 0x2: case 0x3:
+            *avail = 0x4000 - adr;
+            return &card.rombanks[0][adr];
+        case 0x4: case 0x5: case 0x6: case 0x7:
+            *avail = 0x8000 - adr;
+            return &mbc.rombank[adr - 0x4000];
+        case 0xC:
+            *avail = 0xD000 - adr;
+            return &ram.rambanks[0][adr - 0xC000];
+        case 0xD:
+            *avail = 0xE000 - adr;
+            return &ram.rambank[adr - 0xD000];
+    }
+#endif
+    return NULL;
+}
 
-    for(end = lcd.hdma_source + 0x10; lcd.hdma_source < end; lcd.hdma_source++, lcd.hdma_dest++) {
-        mem_write_byte(lcd.hdma_dest, mem_read_byte(lcd.hdma_source));
+/*
+    Copies length bytes as if written by mem_write_byte(), but runs between
+    plain memory and writable VRAM are copied at once.
+*/
+static void dma_copy(u16 source, u16 dest, int length) {
+    const u8 *src;
+    int n, avail;
+    int vram_writable = (lcd.stat & 0x03) != 0x03 || !(lcd.c & 0x80);
+
+    for(; length > 0; length -= n, source += n, dest += n) {
+        src = dma_source(source, &avail);
+        if(src != NULL && vram_writable && dest >= 0x8000 && dest < 0xA000) {
+            n = min(min(length, avail), 0xA000 - dest);
+            vram_block_write(dest - 0x8000, src, n);
+            continue;
+        }
+
+        n = 1;
+        mem_write_byte(dest, mem_read_byte(source));
     }
+}
+
+/*
+    The CPU can't access the source during the transfer, so it doesn't
+    matter that all bytes are copied at its end.
+*/
+static void dma(int mcs) {
+    u8 buf[OAM_SIZE];
+    const u8 *src;
+    int avail, b;
+
+    lcd.dma_active = 0;
+
+    src = dma_source(lcd.dma_source, &avail);
+    if(src == NULL) {
+        for(b = 0; b < OAM_SIZE; b++) {
+            buf[b] = mem_read_byte(lcd.dma_source + b);
+        }
+        src = buf;
+    }
+    oam_block_write(src);
+}
+
+static inline void hdma() {
+    hw_defer(8);
+
+    dma_copy(lcd.hdma_source, lcd.hdma_dest, 0x10);
+    lcd.hdma_source += 0x10;
+    lcd.hdma_dest += 0x10;
 
     if(lcd.hdma_length == 0x00) {
         lcd.hdma_length = 0x7F;
@@ -166,7 +278,7 @@ static void mode_0(int mcs) {
     STAT_SET_MODE(0);
     stat_irq(SIF_HBLANK);
 
-    if(lcd.c & LCDC_DISPLAY_ENABLE_BIT) {
+    if((lcd.c & LCDC_DISPLAY_ENABLE_BIT) && !lcd.skip) {
         draw_line();
     }
     if(!lcd.hdma_inactive) {
@@ -182,8 +294,25 @@ static void mode_1(int mcs) {
 
     cpu.irq |= IF_VBLANK;
     stat_irq(SIF_VBLANK);
-    sys_fb_ready();
-    swap_fb();
+    if(lcd.render_mode == SYS_RENDER_THREADED) {
+        present_pending();
+        if(!lcd.skip) {
+            queue_frame();
+        }
+    }
+    else if(!lcd.skip) {
+        if(lcd.deferred) {
+            defer_flush();
+        }
+        sys_fb_ready();
+        swap_fb();
+    }
+    select_render_mode();
+    lcd.skip = sys_skip_frame();
+
+    if(sys.run_to_vblank) {
+        moo_end_quantum();
+    }
 
     hw_schedule(&lcd.vblank_line_event, DUR_SCANLINE - mcs);
 }
@@ -203,6 +332,7 @@ static void mode_3(int mcs) {
 }
 
 void lcd_reset() {
+    lcd_flush();
     memset(&lcd, 0x00, sizeof(lcd));
 
     lcd.c = 0x91;
@@ -212,24 +342,30 @@ void lcd_reset() {
     lcd.hdma_dest = 0x8000;
     lcd.hdma_inactive = 0x80;
 
-    lcd.clean_fb = lcd.fb[0];
-    lcd.working_fb = lcd.fb[1];
+    lcd.clean_fb = &lcd.fb[0];
+    lcd.working_fb = &lcd.fb[1];
 
     lcd.bgp.b[0] = 0xFC;
     lcd.obp.b[0] = 0xFF;
     lcd.obp.b[1] = 0xFF;
     lcd_rebuild_palette_maps();
-
-    lcd.maps[0].tiles = &ram.vrambanks[0][0x1800];
-    lcd.maps[0].attr = &ram.vrambanks[1][0x1800];
-    lcd.maps[1].tiles = &ram.vrambanks[0][0x1C00];
-    lcd.maps[1].attr = &ram.vrambanks[1][0x1C00];
+    obj_init();
+    render_reset(&lcd.render, ram.vrambanks, ram.oam, &lcd.bgp, &lcd.obp);
+    lcd.render.output = &lcd.output;
 
     lcd.mode_event[0].callback = mode_0;
     lcd.mode_event[1].callback = mode_1;
     lcd.mode_event[2].callback = mode_2;
     lcd.mode_event[3].callback = mode_3;
     lcd.vblank_line_event.callback = vblank_line;
+    lcd.dma_event.callback = dma;
+
+    lcd.mode_event[0].id = HW_EVENT_LCD_MODE_0;
+    lcd.mode_event[1].id = HW_EVENT_LCD_MODE_1;
+    lcd.mode_event[2].id = HW_EVENT_LCD_MODE_2;
+    lcd.mode_event[3].id = HW_EVENT_LCD_MODE_3;
+    lcd.vblank_line_event.id = HW_EVENT_LCD_VBLANK_LINE;
+    lcd.dma_event.id = HW_EVENT_LCD_DMA;
 
 #ifdef DEBUG
     sprintf(lcd.mode_event[0].name, "lcd-mode-0");
@@ -237,42 +373,42 @@ void lcd_reset() {
     sprintf(lcd.mode_event[2].name, "lcd-mode-2");
     sprintf(lcd.mode_event[3].name, "lcd-mode-3");
     sprintf(lcd.vblank_line_event.name, "vblank_line");
+    sprintf(lcd.dma_event.name, "lcd-dma");
 #endif
 }
 
+void lcd_close() {
+    lcd_flush();
+    set_render_mode(SYS_RENDER_IMMEDIATE);
+    defer_close();
+}
+
 void lcd_begin() {
     unschedule();
     hw_schedule(&lcd.vblank_line_event, DUR_MODE_0 + DUR_MODE_2);
 
-    maps_dirty();
+    lcd.skip = 0;
+    set_render_mode(sys.render_mode);
 }
 
 void lcd_dma(u8 v) {
-    u8 b;
-    u16 src;
-
-    for(src = ((u16)v)<<8, b = 0; b < 0xA0; b++, src++) {
-        ram.oam[b] = mem_read_byte(src);
+    if(lcd.dma_active) {
+        hw_unschedule(&lcd.dma_event);
     }
+
+    lcd.dma_source = (u16)v << 8;
+    lcd.dma_active = 1;
+    hw_schedule(&lcd.dma_event, DUR_DMA);
 }
 
 void lcd_gdma() {
     int d;
-    u16 length, source, dest, end;
-
 
     for(d = 0; d <= lcd.hdma_length; d++) {
         hw_step(8);
     }
 
-    length = (lcd.hdma_length + 1) * 0x10;
-    source = lcd.hdma_source;
-    dest = lcd.hdma_dest;
-    end = source + length;
-
-    for(; source < end; source++, dest++) {
-        mem_write_byte(dest, mem_read_byte(source));
-    }
+    dma_copy(lcd.hdma_source, lcd.hdma_dest, (lcd.hdma_length + 1) * 0x10);
 
     lcd.hdma_length = 0x7F;
     lcd.hdma_inactive = 0x80;
@@ -300,6 +436,7 @@ void lcd_enable() {
 }
 
 void lcd_disable() {
+    lcd_flush();
     lcd.ly = 0;
     check_coincidence();
     lcd.stat = (lcd.stat & 0xF8) | 0x00;
@@ -326,10 +463,6 @@ void lcd_c_write(u8 val) {
         }
     }
 
-    if((lcd.c & 0x10) != (val & 0x10)) {
-        maps_dirty();
-    }
-
     lcd.c = val;
 }
 
@@ -340,19 +473,19 @@ void lcd_vram_write(u16 adr, u8 val) {
         return;
     }
 
-    ram.vrambanks[ram.selected_vrambank][vram_adr] = val;
-
-    if(vram_adr >= 0x0000 && vram_adr < 0x1800) {
-        maps_tiledata_dirty(vram_adr/16);
+    if(lcd.deferred) {
+        ram.vrambanks[ram.selected_vrambank][vram_adr] = val;
+        defer_vram_write(ram.selected_vrambank, vram_adr, val);
     }
-    else if(vram_adr >= 0x1800 && vram_adr < 0x1C00) {
-        maps_tile_dirty(&lcd.maps[0], vram_adr - 0x1800);
-    }
-    else if(vram_adr >= 0x1C00) {
-        maps_tile_dirty(&lcd.maps[1], vram_adr - 0x1C00);
+    else {
+        render_vram_write(&lcd.render, ram.selected_vrambank, vram_adr, val);
     }
 }
 
+void lcd_oam_write(u16 adr, u8 val) {
+    oam_write(adr - 0xFE00, val);
+}
+
 static void update_cgb_palettes_map(lcd_palettes_t *palettes, u8 s) {
     u16 palette, color_id, d;
 
@@ -366,16 +499,25 @@ static void update_cgb_palettes_map(lcd_palettes_t *palettes, u8 s) {
         d = palettes->d[s] | palettes->d[s+1] << 8;
     }
 
-    palettes->map[palette][color_id] = sys_map_cgb_color(d);
+    palettes->map[palette][color_id] = d & 0x7FFF;
 }
 
 static void update_dmg_palettes_map(lcd_palettes_t *palettes, u8 s) {
+    static const u16 shades[4] = {DMG_SHADE(0x1F), DMG_SHADE(0x13), DMG_SHADE(0x07), DMG_SHADE(0x00)};
     u8 rc;
 
     for(rc = 0; rc < 4; rc++) {
-        palettes->map[s][rc] = sys_map_dmg_color((palettes->b[s] & (0x3 << (rc<<1))) >> (rc<<1));
+        palettes->map[s][rc] = shades[(palettes->b[s] & (0x3 << (rc<<1))) >> (rc<<1)];
+    }
+}
+
+static void palette_written(lcd_palettes_t *palettes, u8 s, u8 val) {
+    if(lcd.deferred) {
+        defer_palette_write(palettes == &lcd.obp, s, val);
+    }
+    else {
+        render_palette_written(&lcd.render, palettes == &lcd.obp);
     }
-    maps_dirty();
 }
 
 void lcd_palette_control(lcd_palettes_t *palettes, u8 val) {
@@ -390,6 +532,7 @@ void lcd_cgb_palette_data(lcd_palettes_t *palettes, u8 val) {
         palettes->d[palettes->s] = palettes->s & 0x01 ? val&0x7F : val;
 
         update_cgb_palettes_map(palettes, palettes->s);
+        palette_written(palettes, palettes->s, palettes->d[palettes->s]);
 
         if(palettes->i) {
             palettes->s++;
@@ -402,6 +545,7 @@ void lcd_dmg_palette_data(lcd_palettes_t *palettes, u8 val, u8 s) {
     palettes->b[s] = val;
     if(moo.mode == NON_CGB_MODE) {
         update_dmg_palettes_map(palettes, s);
+        palette_written(palettes, s, val);
     }
 }
 
@@ -420,3 +564,70 @@ void lcd_rebuild_palette_maps() {
     }
 }
 
+
+void lcd_update_palettes_map(lcd_palettes_t *palettes, u8 s, int mode) {
+    if(mode == CGB_MODE) {
+        update_cgb_palettes_map(palettes, s);
+    }
+    else {
+        update_dmg_palettes_map(palettes, s);
+    }
+}
+
+void lcd_render_dirty() {
+    if(lcd.deferred) {
+        defer_sync();
+    }
+    else {
+        render_dirty(&lcd.render);
+    }
+}
+
+void lcd_flush() {
+    if(lcd.deferred) {
+        defer_flush();
+    }
+}
+
+/*
+    Lines are additionally written to pixels + ly * pitch as they are drawn,
+    so a host that shows the frame unscaled needs no copy of its own. The
+    frame is complete at sys_fb_ready(). Rendering immediately, the next
+    frame is drawn from the end of VBlank on, lcd.output.complete tells
+    whether pixels still holds the frame to be presented. Not done while
+    rendering threaded, since the render thread draws a frame not yet
+    presented.
+*/
+void lcd_set_output(void *pixels, int pitch, void (*convert)(const u16 *line, void *dst)) {
+    lcd_flush();
+
+    lcd.output.pixels = pixels;
+    lcd.output.pitch = pitch;
+    lcd.output.convert = convert;
+    lcd_invalidate_output();
+}
+
+// The host wrote to the output, it holds no complete frame until the next one is drawn
+void lcd_invalidate_output() {
+    lcd.output.next_ly = -1;
+    lcd.output.complete = NULL;
+}
+
+/*
+    Returns line ly of frame as 15 bit CGB colors, buf provides room for one
+    line if the colors need to be resolved.
+*/
+const u16 *lcd_frame_line(const lcd_frame_t *frame, int ly, u16 *buf) {
+#ifdef LCD_INDEXED_FB
+    const u8 *pixels = &frame->pixels[ly * LCD_WIDTH];
+    const u16 *palette = frame->palettes[frame->line_palettes[ly]];
+    int x;
+
+    for(x = 0; x < LCD_WIDTH; x++) {
+        buf[x] = palette[pixels[x]];
+    }
+    return buf;
+#else
+    return &frame->pixels[ly * LCD_WIDTH];
+#endif
+}
@@ -19,6 +19,29 @@
 #define LCD_WIDTH 160
 #define LCD_HEIGHT 144
 
+#define LCD_OBJ_PER_LINE 10
+
+/*
+    With LCD_INDEXED_FB pixels are palette slots (OBJ << 5 | palette << 2 |
+    color id) that are resolved to colors through the palettes snapshotted
+    for their line, otherwise they are 15 bit CGB colors.
+*/
+#ifdef LCD_INDEXED_FB
+typedef u8 lcd_pixel_t;
+#else
+typedef u16 lcd_pixel_t;
+#endif
+
+#define LCD_PALETTE_SLOTS 64
+
+typedef struct {
+    lcd_pixel_t pixels[LCD_HEIGHT*LCD_WIDTH];
+#ifdef LCD_INDEXED_FB
+    u8 line_palettes[LCD_HEIGHT]; // Index of the snapshot each line uses
+    u8 num_palettes;
+    u16 palettes[LCD_HEIGHT][LCD_PALETTE_SLOTS]; // Snapshots in the order taken, up to one per line
+#endif
+} lcd_frame_t;
 
 typedef struct {
     u8 color_id;
@@ -26,7 +49,7 @@ typedef struct {
 } pixel_meta_t;
 
 typedef struct {
-    u16 scan_cache[256][256];
+    lcd_pixel_t scan_cache[256][256];
     pixel_meta_t cache_meta[256][256];
     u32 cached_palette[32][32][2];
     int tile_dirty[32][32];
@@ -43,6 +66,57 @@ typedef struct {
     u16 map[8][4];
 } lcd_palettes_t;
 
+typedef struct {
+    int diff;
+    int end;
+} obj_range_t;
+
+// Host buffer drawn lines are written to as they are drawn
+typedef struct {
+    void *pixels; // Line 0, NULL if there is no output
+    int pitch;
+    void (*convert)(const u16 *line, void *dst); // NULL to write 15 bit CGB colors
+
+    int next_ly; // Written up to, -1 if not every line of this frame was
+    const lcd_frame_t *complete; // Frame every line of which pixels holds, or NULL
+} lcd_output_t;
+
+typedef struct {
+    u8 *objs[LCD_OBJ_PER_LINE];
+    int count;
+    obj_range_t ranges[LCD_OBJ_PER_LINE];
+    int num_ranges;
+} obj_line_t;
+
+typedef struct {
+    // Registers of the line to be drawn
+    u8 c, ly;
+    u8 scx, scy;
+    u8 wx, wy;
+
+    // Memory the line is drawn from
+    u8 (*vrambanks)[0x2000];
+    u8 *oam;
+    lcd_palettes_t *bgp, *obp;
+    u16 (*bg_map)[4], (*obj_map)[4]; // Palette -> pixel
+    lcd_output_t *output;
+    const int *mode; // moo.mode of the emulator, the render thread has none
+
+#ifdef LCD_INDEXED_FB
+    // Palette snapshots
+    int palettes_dirty;
+    lcd_frame_t *snapshot_frame;
+    int snapshot, last_line;
+#endif
+
+    // Caching
+    u8 cached_c;
+    lcd_map_t maps[2];
+    int index_dirty[2][256];
+    obj_line_t obj_lines[LCD_HEIGHT];
+    int obj_lines_dirty;
+} lcd_render_t;
+
 typedef struct {
     u8 c;
     u8 stat;
@@ -55,28 +129,36 @@ typedef struct {
     lcd_palettes_t bgp, obp;
 
     // Framebuffer
-    u16 fb[2][144*160];
-    u16 *clean_fb;
-    u16 *working_fb;
+    lcd_frame_t fb[3];
+    lcd_frame_t *clean_fb;
+    lcd_frame_t *working_fb;
+    lcd_frame_t *pending_fb; // Finished, but still being drawn by the render thread
+    lcd_output_t output;
 
     // DMA
     u16 hdma_source, hdma_dest;
     u8 hdma_length, hdma_inactive;
+    u16 dma_source;
+    u8 dma_active; // The CPU can only access 0xFF00-0xFFFF
 
-    // Caching
-    lcd_map_t maps[2];
-    int index_dirty[2][256];
+    // Rendering
+    lcd_render_t render;
+    int render_mode;
+    int deferred;
+    int skip; // No pixels are drawn in this frame
 
     // HW events
     hw_event_t mode_event[4];
     hw_event_t vblank_line_event;
+    hw_event_t dma_event;
 } lcd_t;
 
 
-extern lcd_t lcd;
+extern THREAD_LOCAL lcd_t lcd;
 
 
 void lcd_reset();
+void lcd_close();
 void lcd_begin();
 
 void lcd_dma(u8 v);
@@ -90,10 +172,19 @@ void lcd_reset_ly();
 
 void lcd_c_write(u8 val);
 void lcd_vram_write(u16 adr, u8 val);
+void lcd_oam_write(u16 adr, u8 val);
 
 void lcd_palette_control(lcd_palettes_t *palettes, u8 val);
 void lcd_cgb_palette_data(lcd_palettes_t *palettes, u8 val);
 void lcd_dmg_palette_data(lcd_palettes_t *palettes, u8 val, u8 s);
 void lcd_rebuild_palette_maps();
+void lcd_update_palettes_map(lcd_palettes_t *palettes, u8 s, int mode);
+
+void lcd_render_dirty();
+void lcd_flush();
+
+void lcd_set_output(void *pixels, int pitch, void (*convert)(const u16 *line, void *dst));
+void lcd_invalidate_output();
+const u16 *lcd_frame_line(const lcd_frame_t *frame, int ly, u16 *buf);
 
 #endif
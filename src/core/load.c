@@ -14,6 +14,9 @@
 
 #define LOAD_BUFSIZE (1024)
 
+// The ROM loaded from a file, card.rombanks points into it
+static THREAD_LOCAL u8 *file_rom = NULL;
+
 static u8 *load_binary(const char *path, size_t *size) {
     FILE *file;
     size_t r;
@@ -123,7 +126,7 @@ static void init_card(u8 ref) {
     printf("Full cardridge type: %.2X\n", ref);
 }
 
-static void init_rom(u8 ref, u8 *rom, u32 romsize) {
+static void init_rom(u8 ref, const u8 *rom, u32 romsize) {
     card.romsize = rom_bankcount(ref);
     if(card.romsize == 0) {
         return;
@@ -132,11 +135,12 @@ static void init_rom(u8 ref, u8 *rom, u32 romsize) {
         moo_errorf("ROM doesn't fit into banks tightly...");
         return;
     }
-    if(romsize > sizeof(card.rombanks)) {
+    if(card.romsize > CARD_MAX_ROMBANKS) {
         moo_errorf("ROM (size = %i bytes) is too big for banks", romsize);
         return;
     }
-    memcpy(card.rombanks, rom, romsize);
+    card.rombanks = (const u8(*)[0x4000])rom;
+    mbc.rombank = card.rombanks[1];
 
     printf("ROM-size set to %d banks [%.2X]\n", card.romsize, ref);
 }
@@ -148,26 +152,24 @@ static void init_sram(u8 ref) {
     printf("Cardridge-RAM set to %d banks [%i]\n", card.sramsize, ref);
 }
 
-void load_rom() {
-    size_t romsize;
-
-    moo.state &= ~MOO_ROM_LOADED_BIT;
+static void init(const u8 *rom, size_t romsize) {
+    card.rombanks = NULL;
+    card.romsize = 0;
 
-    u8 *rom = load_binary(pathes.rom, &romsize);
-    assert(romsize > 0x014F);
+    if(romsize <= 0x014F) {
+        moo_errorf("ROM (size = %i bytes) is too small", (int)romsize);
+        return;
+    }
 
     init_mode(rom[0x0143]);
     init_card(rom[0x0147]);
     init_rom(rom[0x0148], rom, romsize);
     init_sram(rom[0x0149]);
 
-    card_load();
-
-    mbc.rombank = card.rombanks[1];
     mbc.srambank = card.srambanks[0];
+}
 
-    free(rom);
-
+static void update_loaded() {
     if(~moo.state & MOO_ERROR_BIT) {
         moo.state |= MOO_ROM_LOADED_BIT;
     }
@@ -176,3 +178,40 @@ void load_rom() {
     }
 }
 
+void load_rom() {
+    size_t romsize;
+
+    moo.state &= ~MOO_ROM_LOADED_BIT;
+
+    load_close();
+    file_rom = load_binary(pathes.rom, &romsize);
+    if(file_rom == NULL) {
+        return;
+    }
+
+    init(file_rom, romsize);
+    if(~moo.state & MOO_ERROR_BIT) {
+        card_load();
+    }
+
+    update_loaded();
+}
+
+/*
+    Loads a ROM that isn't backed by a file, so there is no SRAM file either.
+    The ROM isn't copied, it has to stay valid until the next ROM is loaded
+    and can be shared by the emulators of several threads.
+*/
+void load_rom_data(const u8 *rom, size_t romsize) {
+    moo.state &= ~MOO_ROM_LOADED_BIT;
+
+    load_close();
+    init(rom, romsize);
+    update_loaded();
+}
+
+void load_close() {
+    card.rombanks = NULL;
+    free(file_rom);
+    file_rom = NULL;
+}
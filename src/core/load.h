@@ -1,6 +1,11 @@
 #ifndef CORE_LOAD_H
 #define CORE_LOAD_H
 
+#include <stddef.h>
+#include "defines.h"
+
 void load_rom();
+void load_rom_data(const u8 *rom, size_t romsize);
+void load_close();
 
 #endif
@@ -4,9 +4,9 @@
     #include "defines.h"
     #include "lcd.h"
 
-    void lcd_scan_maps(u16 *scan, pixel_meta_t *meta);
-    void maps_tiledata_dirty(int tileindex);
+    void lcd_scan_maps(lcd_render_t *r, lcd_pixel_t *scan, pixel_meta_t *meta);
+    void maps_tiledata_dirty(lcd_render_t *r, u8 bank, int tileindex);
     void maps_tile_dirty(lcd_map_t *map, int tile);
-    void maps_dirty();
+    void maps_dirty(lcd_render_t *r);
 
 #endif
@@ -9,11 +9,15 @@
 #define MBC3_MAP_RAM 0x00
 #define MBC3_MAP_RTC 0x01
 
-mbc_t mbc;
-mbc1_t mbc1;
-mbc3_t mbc3;
-mbc5_t mbc5;
-
+THREAD_LOCAL mbc_t mbc;
+THREAD_LOCAL mbc1_t mbc1;
+THREAD_LOCAL mbc3_t mbc3;
+THREAD_LOCAL mbc5_t mbc5;
+
+// Bank numbers beyond the ROM wrap around, as the cartridge ignores the upper bits
+static const u8 *rombank(int bank) {
+    return card.rombanks[bank % card.romsize];
+}
 
 static void mbc0_lower_write(u16 adr, u8 val) {
     // Nothing to do here
@@ -30,7 +34,7 @@ static void mbc1_lower_write(u16 adr, u8 val) {
             if(mbc1.rombank >= card.romsize) {
                 mbc1.rombank = 1;
             }
-            mbc.rombank = card.rombanks[mbc1.rombank];
+            mbc.rombank = rombank(mbc1.rombank);
         break;
         case 0x4: case 0x5:
             if(mbc1.mode == 0) { // Upper ROM bank bits
@@ -39,7 +43,7 @@ static void mbc1_lower_write(u16 adr, u8 val) {
                 if(mbc1.rombank >= card.romsize) {
                     mbc1.rombank = 1;
                 }
-                mbc.rombank = card.rombanks[mbc1.rombank];
+                mbc.rombank = rombank(mbc1.rombank);
             }
             else { // Cartridge RAM bits
                 mbc.srambank = card.srambanks[val & 0x03];
@@ -60,7 +64,7 @@ static void mbc2_lower_write(u16 adr, u8 val) {
         break;
         case 2: case 3:
             if(adr & 0x10) { // Least significant bit of upper address byte has to be zero.
-                mbc.rombank = card.rombanks[val & 0x0F];
+                mbc.rombank = rombank(val & 0x0F);
             }
         break;
         default:
@@ -74,7 +78,7 @@ static void mbc3_lower_write(u16 adr, u8 val) {
             mbc.ram_selected = (val & 0x0F) == 0x0A;
         break;
         case 2: case 3: // Select ROM bank
-            mbc.rombank = card.rombanks[(val & 0x7F) == 0x00 ? 0x01 : (val & 0x7F)];
+            mbc.rombank = rombank((val & 0x7F) == 0x00 ? 0x01 : (val & 0x7F));
         break;
         case 4: case 5: // Select RAM bank or RTC register
             switch(val & 0x0F) {
@@ -113,7 +117,7 @@ static void mbc5_lower_write(u16 adr, u8 val) {
                 moo_errorf("Illegal request of ROM-bank %i, card only provides %i", mbc5.rombank, card.romsize);
             }
 
-            mbc.rombank = card.rombanks[mbc5.rombank];
+            mbc.rombank = rombank(mbc5.rombank);
         break;
         case 3: // Select upper 1 bit of ROM bank
         break;
@@ -124,7 +128,7 @@ static void mbc5_lower_write(u16 adr, u8 val) {
                 moo_errorf("Illegal request of ROM-bank %i, card only provides %i", mbc5.rombank, card.romsize);
             }
 
-            mbc.rombank = card.rombanks[mbc5.rombank];
+            mbc.rombank = rombank(mbc5.rombank);
         break;
         case 4: case 5:
             if((val&0x0F) >= card.sramsize) {
@@ -8,7 +8,7 @@ typedef struct mbc_s {
 
     void (*lower_write_func)(u16, u8);
 
-    u8 *rombank;
+    const u8 *rombank;
     u8 *srambank;
 
     u8 ram_selected;
@@ -32,10 +32,10 @@ typedef struct {
     u16 rombank;
 } mbc5_t;
 
-extern mbc_t mbc;
-extern mbc1_t mbc1;
-extern mbc3_t mbc3;
-extern mbc5_t mbc5;
+extern THREAD_LOCAL mbc_t mbc;
+extern THREAD_LOCAL mbc1_t mbc1;
+extern THREAD_LOCAL mbc3_t mbc3;
+extern THREAD_LOCAL mbc5_t mbc5;
 
 void mbc_set_type(u8 type);
 
@@ -7,13 +7,14 @@
 #include "lcd.h"
 #include "cpu.h"
 #include "mbc.h"
+#include "util/histogram.h"
 
 #ifdef DEBUG
 #include "debug/watch.h"
 #endif // DEBUG
 
-ram_t ram;
-card_t card;
+THREAD_LOCAL ram_t ram;
+THREAD_LOCAL card_t card;
 
 static u8 read_locked_mem(u16 adr) {
 #ifdef DEBUG
@@ -45,7 +46,7 @@ void mem_reset() {
 u8 mem_read_byte(u16 adr) {
 #ifdef DEBUG
     {
-        static int recurse = 1;
+        static THREAD_LOCAL int recurse = 1;
 
         if (recurse) {
             recurse = 0;
@@ -57,6 +58,12 @@ u8 mem_read_byte(u16 adr) {
     }
 #endif // DEBUG
 
+    HISTOGRAM_READ(adr);
+
+    if(lcd.dma_active && adr < 0xFF00) {
+        return read_locked_mem(adr);
+    }
+
     switch(adr >> 12) {
         case 0x0: case 0x1: case 0x2: case 0x3:
             return card.rombanks[0][adr];
@@ -120,6 +127,13 @@ void mem_write_byte(u16 adr, u8 val) {
     u8 watch_old_val = mem_read_byte(adr);
 #endif // DEBUG
 
+    HISTOGRAM_WRITE(adr);
+
+    if(lcd.dma_active && adr < 0xFF00) {
+        write_locked_mem(adr, val);
+        return;
+    }
+
     switch(adr >> 12) {
         case 0x0: case 0x1: case 0x2: case 0x3:
         case 0x4: case 0x5: case 0x6: case 0x7:
@@ -152,7 +166,7 @@ void mem_write_byte(u16 adr, u8 val) {
             }
             else if(adr >= 0xFE00 && adr < 0xFEA0) { // Sprite attributes
                 if((lcd.stat & 0x03) <= 0x01 || !(lcd.c & 0x80))
-                    ram.oam[adr - 0xFE00] = val;
+                    lcd_oam_write(adr, val);
                 else
                     write_locked_mem(adr, val);
             }
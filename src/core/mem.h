@@ -15,16 +15,18 @@ typedef struct {
     u8 selected_vrambank;
 } ram_t;
 
+#define CARD_MAX_ROMBANKS 256
+
 typedef struct {
     u8 srambanks[4][0x2000];
-    u8 rombanks[256][0x4000];
+    const u8 (*rombanks)[0x4000]; // Not owned, may be shared by several emulators
     u16 romsize;
     u16 sramsize;
 } card_t;
 
 
-extern ram_t ram;
-extern card_t card;
+extern THREAD_LOCAL ram_t ram;
+extern THREAD_LOCAL card_t card;
 
 void mem_reset();
 
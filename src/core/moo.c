@@ -27,13 +27,19 @@
 #include "util/state.h"
 #include "util/pathes.h"
 #include "util/speed.h"
+#include "util/pacing.h"
+#include "util/profile.h"
+#include "util/histogram.h"
+#include "util/sampler.h"
 #include "sound.h"
 
 #ifdef DEBUG
 #include "debug/debug.h"
 #endif
 
-moo_t moo;
+THREAD_LOCAL moo_t moo;
+
+static THREAD_LOCAL int quantum_over;
 
 
 static void on_rom_over() {
@@ -52,14 +58,20 @@ void moo_init() {
 
     sound_init();
     //serial_init();
+    histogram_init();
+    sampler_init();
 
     config_default();
 }
 
 void moo_close() {
+    lcd_close();
     sound_close();
+    load_close();
     pathes_close();
     //serial_close();
+    histogram_flush();
+    sampler_flush();
 }
 
 void moo_reset() {
@@ -73,6 +85,7 @@ void moo_reset() {
     sound_reset();
     joy_reset();
     //serial_reset();
+    sampler_reset();
 
     performance_reset();
     framerate_reset();
@@ -89,6 +102,7 @@ void moo_begin() {
     sys_begin();
     framerate_begin();
     speed_begin();
+    pacing_begin();
 }
 
 void moo_continue() {
@@ -186,23 +200,29 @@ void moo_set_hw(int hw) {
     //serial_update_internal_period();
 }
 
-static void moo_cycle(int num) {
-    unsigned int t;
-
+/*
+    Runs for budget M-cycles, or until the quantum is ended early.
+*/
+void moo_cycle(int budget) {
     sys.invoke_cc = 0;
-    for(t = 0; t < num; t++) {
+    quantum_over = 0;
+
+    while(sys.invoke_cc < budget && !quantum_over) {
         if(cpu.halted) {
             if(ints_handle_standby()) {
                 cpu.halted = 0;
             }
             hw_step(1);
+            SAMPLER_STEP(1);
         }
         else {
 #ifdef DEBUG
             debug_step();
 #endif // DEBUG
             u8 mcs = cpu_step();
+            PROFILE_INSTRUCTION();
             hw_step(mcs);
+            SAMPLER_STEP(mcs);
         }
     }
 }
@@ -222,6 +242,10 @@ void moo_main() {
     }
 }
 
+void moo_end_quantum() {
+    quantum_over = 1;
+}
+
 void moo_notifyf(const char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -233,7 +257,7 @@ void moo_notifyf(const char *format, ...) {
     moo.error = malloc(sizeof(*moo.error));
     vsnprintf(moo.error->text, sizeof(moo.error->text), format, args);
 
-    fprintf(stderr, "NOTIFICATION: "); vfprintf(stderr, format, args); fprintf(stderr, "\n");
+    fprintf(stderr, "NOTIFICATION: %s\n", moo.error->text);
 
     moo.state |= MOO_ERROR_BIT;
     moo_pause();
@@ -252,7 +276,7 @@ void moo_errorf(const char *format, ...) {
     moo.error = malloc(sizeof(*moo.error));
     vsnprintf(moo.error->text, sizeof(moo.error->text), format, args);
 
-    fprintf(stderr, "ERROR: "); vfprintf(stderr, format, args); fprintf(stderr, "\n");
+    fprintf(stderr, "ERROR: %s\n", moo.error->text);
 
     moo.state |= MOO_ERROR_BIT;
     moo.state &= ~MOO_ROM_RUNNING_BIT;
@@ -27,7 +27,7 @@ typedef struct {
     moo_error_t *error;
 } moo_t;
 
-extern moo_t moo;
+extern THREAD_LOCAL moo_t moo;
 
 void moo_init();
 void moo_reset();
@@ -38,6 +38,8 @@ void moo_pause();
 void moo_continue();
 void moo_restart_rom();
 void moo_quit();
+void moo_cycle(int budget);
+void moo_end_quantum();
 void moo_paused_do(void (*func)());
 
 void moo_load_rom(const char *path);
@@ -5,8 +5,8 @@
 #include "defines.h"
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
-#define MAX_PER_LINE 10
 #define OBJ_SIZE 4
 #define OAM_SIZE 0xA0
 #define OAM_OBJ_COUNT 40
@@ -29,116 +29,215 @@
 #define BANK(obj) (((obj)[FLAGS_OFFSET] & BANK_MASK) >> BANK_SHIFT)
 
 
-static u8 obj_height;
-static u8 obj_size_mode;
-static u8 priority;
-static u8 palette;
-static u16 *scan;
-static pixel_meta_t *meta;
-static obj_range_t *ranges;
-static int obj_count;
-static u8 *objs[OAM_OBJ_COUNT];
+static THREAD_LOCAL u8 obj_height;
+static THREAD_LOCAL u8 obj_size_mode;
+static THREAD_LOCAL u8 priority;
+static THREAD_LOCAL u8 palette;
+static THREAD_LOCAL lcd_pixel_t *scan;
+static THREAD_LOCAL pixel_meta_t *meta;
+static THREAD_LOCAL lcd_render_t *r;
+
+// Tile line decoding and merging, see build_tables(). Shared by all emulators.
+static u8 bit_reverse[256];
+static u16 interleave[0x10000];
+static u64 meta_bits[256][2];
+static u64 meta_priority[2];
+static u64 pixel_masks[256][sizeof(lcd_pixel_t)];
+static u64 meta_masks[256][2];
+static pthread_once_t tables_built = PTHREAD_ONCE_INIT;
+
+static void build_tables() {
+    int b, i, p;
+
+    for(b = 0; b < 256; b++) {
+        bit_reverse[b] = 0;
+        for(i = 0; i < 8; i++) {
+            bit_reverse[b] |= ((b >> i) & 0x01) << (7 - i);
+        }
+    }
 
-static inline void render_pixel(u8 *line, u8 rshift, u8 sx) {
-    u8 lsb = (line[0] >> rshift) & 0x01;
-    u8 msb = (line[1] >> rshift) & 0x01;
-    u8 color_id = lsb + (msb << 1);
+    // (msb << 8 | lsb) -> 8 packed 2-bit color ids, leftmost pixel in the upper bits
+    for(i = 0; i < 0x10000; i++) {
+        u8 lsb = i & 0xFF;
+        u8 msb = i >> 8;
 
-    if(color_id != 0) {
-        meta[sx].color_id = color_id;
-        meta[sx].priority = priority;
-        scan[sx] = lcd.obp.map[palette][color_id];
+        interleave[i] = 0;
+        for(p = 0; p < 8; p++) {
+            u8 color_id = ((lsb >> (7 - p)) & 0x01) | (((msb >> (7 - p)) & 0x01) << 1);
+            interleave[i] |= color_id << (14 - p*2);
+        }
     }
-}
 
-static inline void render_obj_line(u8 *line, u8 tx, u8 sx) {
-    s8 rshift;
-    for(rshift = 7 - tx; rshift >= 0 && sx < LCD_WIDTH; rshift--, sx++) {
-        render_pixel(line, rshift, sx);
+    /*
+        Tile line byte -> 8 pixels, leftmost first, as they lie in memory.
+        Bits of the color ids in the metas and masks of opaque pixels.
+    */
+    for(b = 0; b < 256; b++) {
+        pixel_meta_t metas[8], mask_metas[8];
+        lcd_pixel_t mask_pixels[8];
+
+        for(p = 0; p < 8; p++) {
+            u8 bit = (b >> (7 - p)) & 0x01;
+
+            metas[p].color_id = bit;
+            metas[p].priority = 0x00;
+            mask_metas[p].color_id = mask_metas[p].priority = bit ? 0xFF : 0x00;
+            mask_pixels[p] = bit ? (lcd_pixel_t)~0 : 0;
+        }
+        memcpy(meta_bits[b], metas, sizeof(metas));
+        memcpy(meta_masks[b], mask_metas, sizeof(mask_metas));
+        memcpy(pixel_masks[b], mask_pixels, sizeof(mask_pixels));
     }
-}
-
-static inline void render_obj_line_flipped(u8 *line, u8 tx, u8 sx) {
-    u8 rshift;
-    for(rshift = tx; rshift < 8 && sx < LCD_WIDTH; rshift++, sx++) {
-        render_pixel(line, rshift, sx);
+    for(p = 0; p < 8; p++) {
+        pixel_meta_t metas[8] = {{0}};
+
+        metas[p].priority = 0x80;
+        for(i = 0; i < 2; i++) {
+            u64 word;
+            memcpy(&word, (u8*)metas + i * sizeof(word), sizeof(word));
+            meta_priority[i] |= word;
+        }
     }
 }
 
-static void select_obj_indexes() {
-    u8 buf_index;
-    u8 *obj, *oam_end;
+// Replaces the bytes of dst that are set in mask with those of src, 8 at a time
+static inline void merge(void *dst, const u64 *src, const u64 *mask, int words) {
+    int w;
 
-    buf_index = 0;
-    oam_end = ram.oam + OAM_SIZE;
-    for(obj = ram.oam; obj < oam_end; obj += OBJ_SIZE) {
-        s16 top_line = (s16)POSY(obj) - 16;
-        s16 bottom_line = top_line + obj_height;
+    for(w = 0; w < words; w++) {
+        u64 d;
 
-        if((s16)lcd.ly >= top_line && (s16)lcd.ly <= bottom_line) {
-            objs[buf_index++] = obj;
-        }
+        memcpy(&d, (u8*)dst + w * sizeof(d), sizeof(d));
+        d = (d & ~mask[w]) | (src[w] & mask[w]);
+        memcpy((u8*)dst + w * sizeof(d), &d, sizeof(d));
+    }
+}
+
+/*
+    Renders one line of object data with its leftmost pixel at screen
+    position x. The 8 pixels and their metas are built as words and merged
+    into the line through the mask of the opaque ones, pixels off screen
+    land in the padding of the line.
+*/
+static inline void render_obj_line(u8 lsb, u8 msb, int x) {
+    u16 pixels = interleave[(msb << 8) | lsb];
+    u8 opaque = lsb | msb;
+    const u16 *map = r->obj_map[palette];
+    lcd_pixel_t colors[8];
+    u64 words[sizeof(colors) / sizeof(u64)];
+    u64 metas[2];
+    int p;
+
+    for(p = 0; p < 8; p++) {
+        colors[p] = map[(pixels >> (14 - p*2)) & 0x03];
     }
+    memcpy(words, colors, sizeof(colors));
+    merge(&scan[x], words, pixel_masks[opaque], sizeof(words) / sizeof(*words));
 
-    obj_count = buf_index;
+    metas[0] = meta_bits[lsb][0] | meta_bits[msb][0] << 1 | (priority ? meta_priority[0] : 0);
+    metas[1] = meta_bits[lsb][1] | meta_bits[msb][1] << 1 | (priority ? meta_priority[1] : 0);
+    merge(&meta[x], metas, meta_masks[opaque], 2);
 }
 
-#define sort(objs, cmp) { \
-    u8 switched; \
-    do { \
-        u8 o; \
-        switched = 0; \
-        for(o = 0; o + 1 < obj_count; o++) { \
-            if(POSX(objs[o]) cmp POSX(objs[o+1])) { \
-                u8 *tmp = objs[o]; \
-                objs[o] = objs[o+1]; \
-                objs[o+1] = tmp; \
-                switched = 1; \
-            } \
-        } \
-    } while(switched); \
+// Stable insertion sort by x-position, ascending if dir > 0, descending otherwise
+static void sort(u8 **objs, int count, int dir) {
+    int o, p;
+
+    for(o = 1; o < count; o++) {
+        u8 *obj = objs[o];
+        for(p = o; p > 0 && (dir > 0 ? POSX(objs[p-1]) > POSX(obj) : POSX(objs[p-1]) < POSX(obj)); p--) {
+            objs[p] = objs[p-1];
+        }
+        objs[p] = obj;
+    }
 }
 
-static int compute_ranges() {
-    u8 *sorted_objs[OAM_OBJ_COUNT];
+static int compute_ranges(obj_line_t *line) {
+    u8 *sorted_objs[LCD_OBJ_PER_LINE];
+    int obj_count = line->count;
+    obj_range_t *ranges = line->ranges;
     int num = 0;
 
-    memcpy(sorted_objs, objs, sizeof(*sorted_objs) * obj_count);
-    sort(sorted_objs, >);
+    memcpy(sorted_objs, line->objs, sizeof(*sorted_objs) * obj_count);
+    sort(sorted_objs, obj_count, 1);
 
-    int r, o;
+    int i, o;
     int last_range_end = 0;
 
-    for(o = 0, r = 0; o < obj_count; o++, r++) {
+    for(o = 0, i = 0; o < obj_count; o++, i++) {
         if(POSX(sorted_objs[o]) >= 168) {
             break;
         }
 
-        ranges[r].diff = max(POSX(sorted_objs[o]) - 8 - last_range_end, 0);
-        ranges[r].end = min(POSX(sorted_objs[o]), 160);
+        ranges[i].diff = max(POSX(sorted_objs[o]) - 8 - last_range_end, 0);
+        ranges[i].end = min(POSX(sorted_objs[o]), 160);
 
         for(; o < obj_count-1; o++) {
-            if(POSX(sorted_objs[o+1]) - (ranges[r].end + 8) < 8) {
-                ranges[r].end = min(POSX(sorted_objs[o+1]), 160);
+            if(POSX(sorted_objs[o+1]) - (ranges[i].end + 8) < 8) {
+                ranges[i].end = min(POSX(sorted_objs[o+1]), 160);
             }
             else {
                 break;
             }
         }
         num++;
-        last_range_end = ranges[r].end;
+        last_range_end = ranges[i].end;
     }
 
     return num;
 }
 
+/*
+    Distributes all objects onto the lines they cover. Objects are visited in
+    the order they are rendered in (OAM order on CGB, x-sorted on DMG), so
+    each line just keeps the first LCD_OBJ_PER_LINE objects it receives.
+*/
+static void rebuild_lines() {
+    obj_line_t *lines = r->obj_lines;
+    u8 *objs[OAM_OBJ_COUNT];
+    int o, ly;
+
+    for(o = 0; o < OAM_OBJ_COUNT; o++) {
+        objs[o] = &r->oam[o * OBJ_SIZE];
+    }
+    if(*r->mode == NON_CGB_MODE) {
+        sort(objs, OAM_OBJ_COUNT, -1);
+    }
+
+    for(ly = 0; ly < LCD_HEIGHT; ly++) {
+        lines[ly].count = 0;
+    }
+
+    for(o = 0; o < OAM_OBJ_COUNT; o++) {
+        s16 top_line = (s16)POSY(objs[o]) - 16;
+        s16 bottom_line = top_line + obj_height;
+
+        for(ly = max(top_line, 0); ly <= bottom_line && ly < LCD_HEIGHT; ly++) {
+            if(lines[ly].count < LCD_OBJ_PER_LINE) {
+                lines[ly].objs[lines[ly].count++] = objs[o];
+            }
+        }
+    }
+
+    for(ly = 0; ly < LCD_HEIGHT; ly++) {
+        lines[ly].num_ranges = compute_ranges(&lines[ly]);
+    }
+
+    r->obj_lines_dirty = 0;
+}
+
 static void render_obj(u8 *obj) {
     u8 *line_data;
     u8 obj_line, tile_index;
-    s16 sx;
-    u8 tx;
+    u8 lsb, msb;
+    s16 x;
+
+    x = POSX(obj) - 8;
+    if(x >= LCD_WIDTH || x <= -8) {
+        return;
+    }
 
-    obj_line = lcd.ly - (POSY(obj) - 16);
+    obj_line = r->ly - (POSY(obj) - 16);
     if(YFLIP(obj)) {
         obj_line = obj_height - obj_line;
     }
@@ -148,50 +247,52 @@ static void render_obj(u8 *obj) {
         tile_index &= 0xFE;
     }
 
-    line_data = &ram.vrambanks[moo.mode == CGB_MODE ? BANK(obj) : 0][tile_index*0x10 + obj_line*0x02];
-    sx = POSX(obj) - 8;
+    line_data = &r->vrambanks[*r->mode == CGB_MODE ? BANK(obj) : 0][tile_index*0x10 + obj_line*0x02];
 
-    if(sx < 0) {
-        tx = -sx;
-        sx = 0;
+    if(XFLIP(obj)) {
+        lsb = bit_reverse[line_data[0]];
+        msb = bit_reverse[line_data[1]];
     }
     else {
-        tx = 0;
+        lsb = line_data[0];
+        msb = line_data[1];
     }
 
     priority = obj[FLAGS_OFFSET] & 0x80;
-    palette = moo.mode == CGB_MODE ? obj[FLAGS_OFFSET] & 0x07 : (obj[FLAGS_OFFSET] >> 4) & 0x01;
+    palette = *r->mode == CGB_MODE ? obj[FLAGS_OFFSET] & 0x07 : (obj[FLAGS_OFFSET] >> 4) & 0x01;
 
-    if(XFLIP(obj)) {
-        render_obj_line_flipped(line_data, tx, sx);
-    }
-    else {
-        render_obj_line(line_data, tx, sx);
-    }
+    render_obj_line(lsb, msb, x);
 }
 
 
-void lcd_scan_obj(u16 *_scan, pixel_meta_t *_meta, obj_range_t *_ranges, int *num_obj_ranges) {
+void lcd_scan_obj(lcd_render_t *_r, lcd_pixel_t *_scan, pixel_meta_t *_meta, obj_range_t *ranges, int *num_obj_ranges) {
+    obj_line_t *line;
+    int o;
+
+    r = _r;
     scan = _scan;
     meta = _meta;
-    ranges = _ranges;
 
-    obj_size_mode = lcd.c & LCDC_OBJ_SIZE_BIT;
+    obj_size_mode = r->c & LCDC_OBJ_SIZE_BIT;
     obj_height = (obj_size_mode ? 15 : 7);
 
-    select_obj_indexes();
-    *num_obj_ranges = compute_ranges();
-
-    if(moo.mode == NON_CGB_MODE) {
-        sort(objs, <);
+    if(r->obj_lines_dirty) {
+        rebuild_lines();
     }
 
-    obj_count = obj_count > MAX_PER_LINE ? MAX_PER_LINE : obj_count;
+    line = &r->obj_lines[r->ly];
+    memcpy(ranges, line->ranges, line->num_ranges * sizeof(*ranges));
+    *num_obj_ranges = line->num_ranges;
 
-    int o;
-    for(o = obj_count-1; o >= 0; o--) {
-        render_obj(objs[o]);
+    for(o = line->count-1; o >= 0; o--) {
+        render_obj(line->objs[o]);
     }
 }
 
+void obj_init() {
+    pthread_once(&tables_built, build_tables);
+}
 
+void obj_dirty(lcd_render_t *r) {
+    r->obj_lines_dirty = 1;
+}
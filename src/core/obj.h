@@ -13,11 +13,11 @@
 #define OBJ_PALETTE(o) (((o) >> OBJ_PALETTE_SHIFT) & OBJ_PALETTE_MASK)
 #define OBJ_PRIORITY(o) ((o) & OBJ_PRIORITY_BIT)
 
-typedef struct {
-    int diff;
-    int end;
-} obj_range_t;
+// Objects are merged 8 pixels at a time, the lines passed to lcd_scan_obj() need as many on either side
+#define OBJ_LINE_PADDING 8
 
-void lcd_scan_obj(u16 *scan, pixel_meta_t *meta, obj_range_t *ranges, int *num_obj_ranges);
+void lcd_scan_obj(lcd_render_t *r, lcd_pixel_t *scan, pixel_meta_t *meta, obj_range_t *ranges, int *num_obj_ranges);
+void obj_init();
+void obj_dirty(lcd_render_t *r);
 
 #endif
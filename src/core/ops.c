@@ -6,6 +6,7 @@
 #include "hw.h"
 #include "mem.h"
 #include "defines.h"
+#include "util/sampler.h"
 
 static u8 mcs[256] = {
 //  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
@@ -300,6 +301,7 @@ static inline int jp(int cond, u16 adr) {
 static inline void rst(u8 val) {
     push(PC);
     PC = val;
+    SAMPLER_CALL(val);
 }
 
 static inline int ret(int cond) {
@@ -316,6 +318,7 @@ static inline int call(int cond, u16 adr) {
     if(cond) {
         push(PC);
         PC = adr;
+        SAMPLER_CALL(adr);
         return 6;
     }
     else {
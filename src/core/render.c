@@ -0,0 +1,256 @@
+#include "render.h"
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "moo.h"
+#include "defines.h"
+#include "obj.h"
+#include "maps.h"
+#include "util/profile.h"
+
+
+static THREAD_LOCAL lcd_render_t *r;
+
+#ifdef LCD_INDEXED_FB
+// The palette slot of every palette and color id, see lcd_pixel_t. Shared by all emulators.
+static u16 slots[2][8][4];
+static pthread_once_t slots_built = PTHREAD_ONCE_INIT;
+
+static void build_slots() {
+    int obj, palette, color_id;
+
+    for(obj = 0; obj < 2; obj++) {
+        for(palette = 0; palette < 8; palette++) {
+            for(color_id = 0; color_id < 4; color_id++) {
+                slots[obj][palette][color_id] = obj << 5 | palette << 2 | color_id;
+            }
+        }
+    }
+}
+
+/*
+    Lines share the snapshot of an earlier line of the frame as long as the
+    palettes weren't written since, so only frame->num_palettes snapshots
+    are in use.
+*/
+static void snapshot_palettes(lcd_frame_t *frame) {
+    if(frame != r->snapshot_frame || r->ly <= r->last_line) {
+        frame->num_palettes = 0;
+        r->palettes_dirty = 1;
+    }
+    if(r->palettes_dirty) {
+        r->snapshot = frame->num_palettes++;
+        memcpy(&frame->palettes[r->snapshot][0], r->bgp->map, sizeof(r->bgp->map));
+        memcpy(&frame->palettes[r->snapshot][32], r->obp->map, sizeof(r->obp->map));
+
+        r->palettes_dirty = 0;
+        r->snapshot_frame = frame;
+    }
+    frame->line_palettes[r->ly] = r->snapshot;
+    r->last_line = r->ly;
+}
+#endif
+
+static inline int cgb_priority(int maps_color_id, int maps_priority, int obj_color_id, int obj_priority) {
+    int bg_priority = (r->c & LCDC_BG_ENABLE_BIT) && (maps_priority || obj_priority);
+    return (bg_priority && maps_color_id != 0) || obj_color_id == 0;
+}
+
+static inline int dmg_priority(int maps_color_id, int maps_priority, int obj_color_id, int obj_priority) {
+    return (obj_priority && maps_color_id != 0) || obj_color_id == 0;
+}
+
+static void output_line(lcd_frame_t *frame) {
+    lcd_output_t *output = r->output;
+    u16 buf[LCD_WIDTH];
+    const u16 *line = lcd_frame_line(frame, r->ly, buf);
+    u8 *dst = (u8*)output->pixels + r->ly * output->pitch;
+
+    PROFILE_ENTER(PROFILE_VIDEO);
+    if(output->convert != NULL) {
+        output->convert(line, dst);
+    }
+    else {
+        memcpy(dst, line, sizeof(buf));
+    }
+
+    output->next_ly = r->ly == 0 || r->ly == output->next_ly ? r->ly + 1 : -1;
+    output->complete = output->next_ly == LCD_HEIGHT ? frame : NULL;
+    PROFILE_LEAVE();
+}
+
+void render_reset(lcd_render_t *_r, u8 (*vrambanks)[0x2000], u8 *oam, lcd_palettes_t *bgp, lcd_palettes_t *obp) {
+    _r->vrambanks = vrambanks;
+    _r->oam = oam;
+    _r->bgp = bgp;
+    _r->obp = obp;
+    _r->mode = &moo.mode;
+
+    _r->maps[0].tiles = &vrambanks[0][0x1800];
+    _r->maps[0].attr = &vrambanks[1][0x1800];
+    _r->maps[1].tiles = &vrambanks[0][0x1C00];
+    _r->maps[1].attr = &vrambanks[1][0x1C00];
+
+#ifdef LCD_INDEXED_FB
+    pthread_once(&slots_built, build_slots);
+    _r->bg_map = slots[0];
+    _r->obj_map = slots[1];
+    _r->snapshot_frame = NULL;
+#else
+    _r->bg_map = bgp->map;
+    _r->obj_map = obp->map;
+#endif
+
+    render_dirty(_r);
+}
+
+void render_dirty(lcd_render_t *_r) {
+    maps_dirty(_r);
+    obj_dirty(_r);
+#ifdef LCD_INDEXED_FB
+    _r->palettes_dirty = 1;
+#endif
+}
+
+/*
+    Draws line r->ly as configured by the register fields of r to frame.
+*/
+void render_line(lcd_render_t *_r, lcd_frame_t *frame) {
+    lcd_pixel_t obj_line[OBJ_LINE_PADDING + 160 + OBJ_LINE_PADDING], maps_scan[160];
+    lcd_pixel_t *obj_scan = &obj_line[OBJ_LINE_PADDING];
+    lcd_pixel_t *pixel = &frame->pixels[_r->ly * LCD_WIDTH];
+    pixel_meta_t obj_line_meta[OBJ_LINE_PADDING + 160 + OBJ_LINE_PADDING], maps_meta[160];
+    pixel_meta_t *obj_meta = &obj_line_meta[OBJ_LINE_PADDING];
+    obj_range_t obj_ranges[11];
+    int x, o;
+    int (*priority_func)(int, int, int, int);
+    int num_obj_ranges;
+
+    PROFILE_ENTER(PROFILE_PPU);
+    r = _r;
+
+    if((r->c ^ r->cached_c) & LCDC_TILE_DATA_BIT) {
+        maps_dirty(r);
+    }
+    if((r->c ^ r->cached_c) & LCDC_OBJ_SIZE_BIT) {
+        obj_dirty(r);
+    }
+    r->cached_c = r->c;
+
+    memset(obj_line, 0x00, sizeof(obj_line));
+    memset(obj_line_meta, 0x00, sizeof(obj_line_meta));
+
+    lcd_scan_maps(r, maps_scan, maps_meta);
+
+    if(r->c & LCDC_OBJ_ENABLE_BIT) {
+        lcd_scan_obj(r, obj_scan, obj_meta, obj_ranges, &num_obj_ranges);
+
+        priority_func = *r->mode == CGB_MODE ? cgb_priority : dmg_priority;
+
+        for(x = 0, o = 0; o < num_obj_ranges; o++) {
+            memcpy(pixel, &maps_scan[x], obj_ranges[o].diff * sizeof(*pixel));
+            x += obj_ranges[o].diff; assert(x <= 160);
+            pixel += obj_ranges[o].diff;
+
+            for(; x < obj_ranges[o].end; x++, pixel++) {
+                if(priority_func(maps_meta[x].color_id, maps_meta[x].priority, obj_meta[x].color_id, obj_meta[x].priority)) {
+                    *pixel = maps_scan[x];
+                }
+                else {
+                    *pixel = obj_scan[x];
+                }
+            }
+        }
+        memcpy(pixel, &maps_scan[x], (160-x) * sizeof(*pixel));
+    }
+    else {
+        memcpy(pixel, maps_scan, 160 * sizeof(*maps_scan));
+    }
+
+#ifdef LCD_INDEXED_FB
+    snapshot_palettes(frame);
+#endif
+
+    if(r->output != NULL && r->output->pixels != NULL) {
+        output_line(frame);
+    }
+    PROFILE_LEAVE();
+}
+
+void render_vram_write(lcd_render_t *_r, u8 bank, u16 vram_adr, u8 val) {
+    _r->vrambanks[bank][vram_adr] = val;
+
+    if(vram_adr < 0x1800) {
+        maps_tiledata_dirty(_r, bank, vram_adr/16);
+    }
+    else if(vram_adr < 0x1C00) {
+        maps_tile_dirty(&_r->maps[0], vram_adr - 0x1800);
+    }
+    else {
+        maps_tile_dirty(&_r->maps[1], vram_adr - 0x1C00);
+    }
+}
+
+/*
+    Marks everything drawn from vram_adr to vram_adr + len dirty at once, so
+    a tile is only invalidated once however many of its bytes were written.
+*/
+void render_vram_block_write(lcd_render_t *_r, u8 bank, u16 vram_adr, const u8 *src, int len) {
+    int begin, end, a;
+
+    memcpy(&_r->vrambanks[bank][vram_adr], src, len);
+
+    end = min(vram_adr + len, 0x1800);
+    for(a = vram_adr; a < end; a += 16 - a % 16) {
+        maps_tiledata_dirty(_r, bank, a/16);
+    }
+
+    begin = max(vram_adr, 0x1800);
+    end = min(vram_adr + len, 0x1C00);
+    for(a = begin; a < end; a++) {
+        maps_tile_dirty(&_r->maps[0], a - 0x1800);
+    }
+
+    begin = max(vram_adr, 0x1C00);
+    end = vram_adr + len;
+    for(a = begin; a < end; a++) {
+        maps_tile_dirty(&_r->maps[1], a - 0x1C00);
+    }
+}
+
+void render_oam_write(lcd_render_t *_r, u8 oam_adr, u8 val) {
+    _r->oam[oam_adr] = val;
+    obj_dirty(_r);
+}
+
+void render_oam_block_write(lcd_render_t *_r, u8 oam_adr, const u8 *src, int len) {
+    memcpy(&_r->oam[oam_adr], src, len);
+    obj_dirty(_r);
+}
+
+void render_palette_write(lcd_render_t *_r, int obp, u8 s, u8 val) {
+    lcd_palettes_t *palettes = obp ? _r->obp : _r->bgp;
+
+    if(*_r->mode == CGB_MODE) {
+        palettes->d[s] = val;
+    }
+    else {
+        palettes->b[s] = val;
+    }
+    lcd_update_palettes_map(palettes, s, *_r->mode);
+    render_palette_written(_r, obp);
+}
+
+/*
+    Colors are only cached if the pixels are colors, DMG maps are cached
+    without regard to the palette.
+*/
+void render_palette_written(lcd_render_t *_r, int obp) {
+#ifdef LCD_INDEXED_FB
+    _r->palettes_dirty = 1;
+#else
+    if(!obp && *_r->mode == NON_CGB_MODE) {
+        maps_dirty(_r);
+    }
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef CORE_RENDER_H
+#define CORE_RENDER_H
+
+#include "defines.h"
+#include "lcd.h"
+
+void render_reset(lcd_render_t *r, u8 (*vrambanks)[0x2000], u8 *oam, lcd_palettes_t *bgp, lcd_palettes_t *obp);
+void render_dirty(lcd_render_t *r);
+void render_line(lcd_render_t *r, lcd_frame_t *frame);
+
+void render_vram_write(lcd_render_t *r, u8 bank, u16 vram_adr, u8 val);
+void render_vram_block_write(lcd_render_t *r, u8 bank, u16 vram_adr, const u8 *src, int len);
+void render_oam_write(lcd_render_t *r, u8 oam_adr, u8 val);
+void render_oam_block_write(lcd_render_t *r, u8 oam_adr, const u8 *src, int len);
+void render_palette_write(lcd_render_t *r, int obp, u8 s, u8 val);
+void render_palette_written(lcd_render_t *r, int obp);
+
+#endif
@@ -13,9 +13,9 @@
 #define DL 0x03
 #define DH 0x04
 
-rtc_t rtc;
+THREAD_LOCAL rtc_t rtc;
 
-hw_event_t rtc_event;
+THREAD_LOCAL hw_event_t rtc_event;
 
 static void rtc_next_day() {
     u16 d = rtc.ticking[DL] | ((rtc.ticking[DH] & 0x01) << 8);
@@ -59,6 +59,7 @@ void rtc_reset() {
     memset(&rtc, 0x00, sizeof(rtc));
 
     rtc_event.callback = step;
+    rtc_event.id = HW_EVENT_RTC;
 
 #ifdef DEBUG
     sprintf(rtc_event.name, "rtc");
@@ -13,9 +13,9 @@ typedef struct {
     u32 cc;
 } rtc_t;
 
-extern rtc_t rtc;
+extern THREAD_LOCAL rtc_t rtc;
 
-extern hw_event_t rtc_event;
+extern THREAD_LOCAL hw_event_t rtc_event;
 
 void rtc_reset();
 void rtc_begin();
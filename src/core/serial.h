@@ -13,7 +13,7 @@ typedef struct {
     int num_in, num_out;
 } serial_t;
 
-extern serial_t serial;
+extern THREAD_LOCAL serial_t serial;
 
 void serial_reset();
 void serial_step();
@@ -3,6 +3,7 @@
 #include "hw.h"
 #include "defines.h"
 #include "sys/sys.h"
+#include "util/profile.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -12,17 +13,17 @@ typedef struct {
     u16 l, r;
 } sample_t;
 
-sound_t sound;
-sqw_t sqw[2];
-sweep_t sweep;
-env_t env[3];
-wave_t wave;
-noise_t noise;
+THREAD_LOCAL sound_t sound;
+THREAD_LOCAL sqw_t sqw[2];
+THREAD_LOCAL sweep_t sweep;
+THREAD_LOCAL env_t env[3];
+THREAD_LOCAL wave_t wave;
+THREAD_LOCAL noise_t noise;
 
-hw_event_t sound_mix_event;
-hw_event_t sound_length_counters_event;
-hw_event_t sound_sweep_event;
-hw_event_t sound_envelopes_event;
+THREAD_LOCAL hw_event_t sound_mix_event;
+THREAD_LOCAL hw_event_t sound_length_counters_event;
+THREAD_LOCAL hw_event_t sound_sweep_event;
+THREAD_LOCAL hw_event_t sound_envelopes_event;
 
 static inline void step_length_counter(counter_t *counter, u8 *on) {
     if(counter->length > 0) {
@@ -244,6 +245,11 @@ void sound_reset() {
     sound_sweep_event.callback = step_sweep;
     sound_envelopes_event.callback = step_envelopes;
 
+    sound_mix_event.id = HW_EVENT_SOUND_MIX;
+    sound_length_counters_event.id = HW_EVENT_SOUND_LENGTH_COUNTERS;
+    sound_sweep_event.id = HW_EVENT_SOUND_SWEEP;
+    sound_envelopes_event.id = HW_EVENT_SOUND_ENVELOPES;
+
 #ifdef DEBUG
     sprintf(sound_mix_event.name, "mix");
     sprintf(sound_length_counters_event.name, "length_counters");
@@ -268,6 +274,7 @@ void sound_mix() {
 
     u16 *buf = (u16*)sys.sound_buf;
 
+    PROFILE_ENTER(PROFILE_APU);
     if(!sound.on) {
         buf[sys.sound_buf_end*2 + 0] = 0x0000;
         buf[sys.sound_buf_end*2 + 1] = 0x0000;
@@ -291,6 +298,7 @@ void sound_mix() {
     }
     sys.sound_buf_end++;
     sys.sound_buf_end %= sys.sound_buf_size;
+    PROFILE_LEAVE();
 }
 
 void sound_write(u8 sadr, u8 val) {
@@ -67,18 +67,18 @@ typedef struct {
     counter_t counter;
 } noise_t;
 
-extern sound_t sound;
-
-extern hw_event_t sound_mix_event;
-extern hw_event_t sound_length_counters_event;
-extern hw_event_t sound_sweep_event;
-extern hw_event_t sound_envelopes_event;
-
-extern sqw_t sqw[2];
-extern env_t env[3];
-extern sweep_t sweep;
-extern wave_t wave;
-extern noise_t noise;
+extern THREAD_LOCAL sound_t sound;
+
+extern THREAD_LOCAL hw_event_t sound_mix_event;
+extern THREAD_LOCAL hw_event_t sound_length_counters_event;
+extern THREAD_LOCAL hw_event_t sound_sweep_event;
+extern THREAD_LOCAL hw_event_t sound_envelopes_event;
+
+extern THREAD_LOCAL sqw_t sqw[2];
+extern THREAD_LOCAL env_t env[3];
+extern THREAD_LOCAL sweep_t sweep;
+extern THREAD_LOCAL wave_t wave;
+extern THREAD_LOCAL noise_t noise;
 
 void sound_init();
 void sound_close();
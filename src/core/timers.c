@@ -6,12 +6,12 @@
 
 #define MCS_PER_DIVT 32
 
-timers_t timers;
+THREAD_LOCAL timers_t timers;
 
 static const u16 MCS_PER_TIMA[4] = {0x100, 0x04, 0x10, 0x40};
 
-hw_event_t timers_div_event;
-hw_event_t timers_tima_event;
+THREAD_LOCAL hw_event_t timers_div_event;
+THREAD_LOCAL hw_event_t timers_tima_event;
 
 
 static void div_step(int mcs) {
@@ -45,6 +45,8 @@ void timers_reset() {
 
     timers_div_event.callback = div_step;
     timers_tima_event.callback = timer_step;
+    timers_div_event.id = HW_EVENT_TIMERS_DIV;
+    timers_tima_event.id = HW_EVENT_TIMERS_TIMA;
 
 #ifdef DEBUG
     sprintf(timers_div_event.name, "div");
@@ -12,10 +12,10 @@ typedef struct {
     u32 div_cc, tima_cc;
 } timers_t;
 
-extern timers_t timers;
+extern THREAD_LOCAL timers_t timers;
 
-extern hw_event_t timers_div_event;
-extern hw_event_t timers_tima_event;
+extern THREAD_LOCAL hw_event_t timers_div_event;
+extern THREAD_LOCAL hw_event_t timers_tima_event;
 
 
 void timers_reset();
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib/mooboy.h"
+
+/*
+    Runs a ROM for a number of frames without any devices and prints a hash
+    of the last frame, optionally writing it to a PPM.
+*/
+
+static uint16_t frame[MOOBOY_WIDTH * MOOBOY_HEIGHT];
+
+static int write_ppm(const char *path) {
+    FILE *file;
+    int p;
+
+    file = fopen(path, "wb");
+    if(file == NULL) {
+        return 0;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", MOOBOY_WIDTH, MOOBOY_HEIGHT);
+    for(p = 0; p < MOOBOY_WIDTH * MOOBOY_HEIGHT; p++) {
+        uint16_t c = frame[p];
+
+        fputc(((c >> 0) & 0x1F) << 3, file);
+        fputc(((c >> 5) & 0x1F) << 3, file);
+        fputc(((c >> 10) & 0x1F) << 3, file);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+int main(int argc, const char **argv) {
+    int frames, ran;
+
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s <rom> [frames] [out.ppm]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    frames = argc > 2 ? atoi(argv[2]) : 600;
+
+    mooboy_init();
+
+    if(!mooboy_load_rom_file(argv[1])) {
+        fprintf(stderr, "%s\n", mooboy_error());
+        mooboy_close();
+        return EXIT_FAILURE;
+    }
+
+    ran = mooboy_run_frames(frames);
+    mooboy_framebuffer(frame);
+
+    if(argc > 3 && !write_ppm(argv[3])) {
+        fprintf(stderr, "Failed to write '%s'\n", argv[3]);
+    }
+
+    printf("frames %d hash %.8x\n", ran, mooboy_framebuffer_hash());
+
+    mooboy_close();
+
+    return ran == frames ? EXIT_SUCCESS : EXIT_FAILURE;
+}
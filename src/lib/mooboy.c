@@ -0,0 +1,233 @@
+#include "mooboy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/moo.h"
+#include "core/cpu.h"
+#include "core/joy.h"
+#include "core/lcd.h"
+#include "core/mbc.h"
+#include "core/load.h"
+#include "sys/sys.h"
+
+#define FRAME_MCS 17556
+
+// ROM read by mooboy_load_rom_file(), the emulator runs from it
+static THREAD_LOCAL uint8_t *file_rom = NULL;
+
+// M-cycles run since the ROM was loaded, hw.cc wraps too early
+static THREAD_LOCAL uint64_t cycles = 0;
+// Emulated time since then, in half M-cycles at single speed
+static THREAD_LOCAL uint64_t half_mcs = 0;
+
+static void free_file_rom() {
+    free(file_rom);
+    file_rom = NULL;
+}
+
+void mooboy_init() {
+    sys_init(0, NULL);
+    moo_init();
+    moo.state = MOO_RUNNING_BIT;
+}
+
+void mooboy_close() {
+    lcd_flush();
+    moo_close();
+    sys_close();
+    free_file_rom();
+}
+
+/*
+    Returns 1 if the ROM was loaded, see mooboy_error() otherwise. The ROM
+    isn't copied, it has to stay valid until the next ROM is loaded or the
+    emulator is closed. Emulators on other threads may run from it as well.
+*/
+int mooboy_load_rom(const uint8_t *rom, size_t size) {
+    moo_clear_error();
+    moo_reset();
+    load_rom_data(rom, size);
+    cycles = 0;
+    half_mcs = 0;
+
+    if(~moo.state & MOO_ROM_LOADED_BIT) {
+        return 0;
+    }
+
+    moo_begin();
+    return 1;
+}
+
+int mooboy_load_rom_file(const char *path) {
+    FILE *file;
+    uint8_t *rom;
+    long size;
+    int loaded;
+
+    file = fopen(path, "rb");
+    if(file == NULL) {
+        moo_errorf("Failed to open ROM '%s'", path);
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    rom = malloc(size);
+    if(size <= 0 || fread(rom, 1, size, file) != (size_t)size) {
+        moo_errorf("Failed to read ROM '%s'", path);
+        free(rom);
+        loaded = 0;
+    }
+    else {
+        // The previous ROM is detached by loading this one
+        loaded = mooboy_load_rom(rom, size);
+        free_file_rom();
+        file_rom = rom;
+    }
+
+    fclose(file);
+
+    return loaded;
+}
+
+const char *mooboy_error() {
+    return (moo.state & MOO_ERROR_BIT) && moo.error != NULL ? moo.error->text : NULL;
+}
+
+static int running() {
+    return (moo.state & MOO_ROM_RUNNING_BIT) && (~moo.state & MOO_ERROR_BIT);
+}
+
+static void cycle(int mcs) {
+    moo_cycle(mcs);
+    cycles += sys.invoke_cc;
+    half_mcs += sys.invoke_cc * 2 / cpu.freq_factor;
+}
+
+void mooboy_run_cycles(int mcs) {
+    while(mcs > 0 && running()) {
+        cycle(mcs);
+        mcs -= sys.invoke_cc;
+    }
+}
+
+/*
+    Runs until frames frames were finished. While the LCD is off, every
+    frame's worth of M-cycles counts as a frame. Rendering threaded, a frame
+    is finished one VBlank late, so the emulation is a frame ahead of it.
+    Returns the number of frames run.
+*/
+int mooboy_run_frames(int frames) {
+    int f;
+
+    for(f = 0; f < frames && running(); f++) {
+        sys.fb_ready = 0;
+        while(!sys.fb_ready && running()) {
+            cycle(FRAME_MCS * cpu.freq_factor);
+            if(!(lcd.c & LCDC_DISPLAY_ENABLE_BIT)) {
+                break;
+            }
+        }
+    }
+
+    return f;
+}
+
+// CPU M-cycles, in double speed twice as many per second
+uint64_t mooboy_cycles() {
+    return cycles;
+}
+
+/*
+    Emulated time in M-cycles at single speed, 1048576 per second whatever
+    the CPU speed. A speed switch counts from the end of the quantum it
+    happened in.
+*/
+uint64_t mooboy_elapsed_mcs() {
+    return half_mcs / 2;
+}
+
+// 0 for cartridges without MBC, 1, 2, 3 or 5 otherwise
+int mooboy_mbc() {
+    return mbc.type;
+}
+
+void mooboy_set_buttons(uint8_t pressed) {
+    int b;
+
+    for(b = 0; b < 8; b++) {
+        joy_set_button(1 << b, pressed & (1 << b) ? JOY_STATE_PRESSED : JOY_STATE_RELEASED);
+    }
+}
+
+// Copies the last finished frame to dst as 15 bit CGB colors
+void mooboy_framebuffer(uint16_t *dst) {
+    int ly;
+
+    lcd_flush();
+    for(ly = 0; ly < LCD_HEIGHT; ly++) {
+        u16 *line = &dst[ly * LCD_WIDTH];
+        const u16 *src = lcd_frame_line(lcd.clean_fb, ly, line);
+
+        if(src != line) {
+            memcpy(line, src, LCD_WIDTH * sizeof(*line));
+        }
+    }
+}
+
+// FNV-1a over the frame mooboy_framebuffer() returns
+uint32_t mooboy_framebuffer_hash() {
+    uint16_t frame[LCD_WIDTH * LCD_HEIGHT];
+    uint32_t hash = 2166136261u;
+    int p;
+
+    mooboy_framebuffer(frame);
+    for(p = 0; p < LCD_WIDTH * LCD_HEIGHT; p++) {
+        hash = (hash ^ (frame[p] & 0xFF)) * 16777619u;
+        hash = (hash ^ (frame[p] >> 8)) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+    Immediate draws every line when the LCD reaches it. Deferred only logs
+    the line registers and the writes to VRAM, OAM and the palettes, and
+    replays the log in one pass at VBlank. It replays early only when the
+    log is full or the frame has to be read back, e.g. to save a state,
+    when the LCD is turned off or the output changes. Threaded replays the
+    log on a thread of its own while the core runs on, and presents every
+    frame a VBlank late. All render the same frames. The mode is switched
+    at the next VBlank.
+*/
+void mooboy_set_render_mode(int mode) {
+    sys.render_mode = mode;
+}
+
+// See lcd_set_output()
+void mooboy_set_output(void *pixels, int pitch, void (*convert)(const uint16_t *line, void *dst)) {
+    lcd_set_output(pixels, pitch, convert);
+}
+
+/*
+    Moves up to max_frames stereo frames of audio into dst and returns how
+    many were moved.
+*/
+int mooboy_audio(int16_t *dst, int max_frames) {
+    int16_t *buf = (int16_t*)sys.sound_buf;
+    int n;
+
+    for(n = 0; n < max_frames && sys.sound_buf_start != sys.sound_buf_end; n++) {
+        dst[n*2 + 0] = buf[sys.sound_buf_start*2 + 0];
+        dst[n*2 + 1] = buf[sys.sound_buf_start*2 + 1];
+        sys.sound_buf_start = (sys.sound_buf_start + 1) % sys.sound_buf_size;
+    }
+
+    return n;
+}
+
+int mooboy_sound_freq() {
+    return sys.sound_freq;
+}
@@ -0,0 +1,54 @@
+#ifndef LIB_MOOBOY_H
+#define LIB_MOOBOY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Embedding API of libmooboy: The emulator without any devices, for
+    running ROMs headless. Every thread has an emulator of its own, so
+    threads can run ROMs independently and share the ROM data. ROMs are
+    loaded from memory and no files are written.
+*/
+
+#define MOOBOY_WIDTH 160
+#define MOOBOY_HEIGHT 144
+
+// Buttons, as passed to mooboy_set_buttons()
+#define MOOBOY_BUTTON_RIGHT  0x01
+#define MOOBOY_BUTTON_LEFT   0x02
+#define MOOBOY_BUTTON_UP     0x04
+#define MOOBOY_BUTTON_DOWN   0x08
+#define MOOBOY_BUTTON_A      0x10
+#define MOOBOY_BUTTON_B      0x20
+#define MOOBOY_BUTTON_SELECT 0x40
+#define MOOBOY_BUTTON_START  0x80
+
+// Rendering modes, as passed to mooboy_set_render_mode()
+#define MOOBOY_RENDER_IMMEDIATE 0
+#define MOOBOY_RENDER_DEFERRED  1
+#define MOOBOY_RENDER_THREADED  2
+
+void mooboy_init();
+void mooboy_close();
+
+int mooboy_load_rom(const uint8_t *rom, size_t size);
+int mooboy_load_rom_file(const char *path);
+const char *mooboy_error();
+
+void mooboy_run_cycles(int mcs);
+int mooboy_run_frames(int frames);
+uint64_t mooboy_cycles();
+uint64_t mooboy_elapsed_mcs();
+int mooboy_mbc();
+
+void mooboy_set_buttons(uint8_t pressed);
+
+void mooboy_framebuffer(uint16_t *dst);
+uint32_t mooboy_framebuffer_hash();
+void mooboy_set_render_mode(int mode);
+void mooboy_set_output(void *pixels, int pitch, void (*convert)(const uint16_t *line, void *dst));
+int mooboy_audio(int16_t *dst, int max_frames);
+int mooboy_sound_freq();
+
+#endif
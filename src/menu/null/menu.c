@@ -0,0 +1,29 @@
+#include "menu/menu.h"
+#include <stdio.h>
+#include "core/moo.h"
+
+/*
+    There is no one to ask, so the menu neither stops nor continues
+    anything and errors are only reported.
+*/
+
+void menu_init() {
+}
+
+void menu_close() {
+}
+
+void menu_run() {
+    moo_quit();
+}
+
+void menu_error() {
+    fprintf(stderr, "%s\n", moo.error != NULL ? moo.error->text : "Unknown error");
+    moo_quit();
+}
+
+void menu_continue() {
+}
+
+void menu_warn_rtc_sav_conflict() {
+}
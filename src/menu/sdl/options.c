@@ -19,6 +19,9 @@
 #define LABEL_LOAD_GLOBAL 8
 #define LABEL_RESET 9
 #define LABEL_SPEED_FACTOR 10
+#define LABEL_RENDERING 11
+#define LABEL_COLOR_CORRECTION 12
+#define LABEL_RUN_TO_VBLANK 13
 
 
 static menu_list_t *list = NULL;
@@ -53,6 +56,22 @@ static void change_scaling(int dir) {
     menu_listentry_val(list, LABEL_SCALING,  sys.scalingmode_names[sys.scalingmode]);
 }
 
+static void change_rendering(int dir) {
+    sys.render_mode += dir;
+    sys.render_mode = sys.render_mode < 0 ? SYS_RENDER_THREADED : sys.render_mode % 3;
+    menu_listentry_val(list, LABEL_RENDERING, sys.render_mode == SYS_RENDER_THREADED ? "threaded" : sys.render_mode == SYS_RENDER_DEFERRED ? "deferred" : "immediate");
+}
+
+static void change_color_correction(int dir) {
+    sys.color_correction = dir ? !sys.color_correction : sys.color_correction;
+    menu_listentry_val(list, LABEL_COLOR_CORRECTION, sys.color_correction ? "on" : "off");
+}
+
+static void change_run_to_vblank(int dir) {
+    sys.run_to_vblank = dir ? !sys.run_to_vblank : sys.run_to_vblank;
+    menu_listentry_val(list, LABEL_RUN_TO_VBLANK, sys.run_to_vblank ? "yes" : "no");
+}
+
 static void change_statusbar(int dir) {
     sys.show_statusbar = dir ? !sys.show_statusbar : sys.show_statusbar;
     menu_listentry_val(list, LABEL_STATUSBAR, sys.show_statusbar ? "show" : "hide");
@@ -73,6 +92,9 @@ static void update_options() {
     change_sound(0);
     change_speed_factor(0);
     change_scaling(0);
+    change_rendering(0);
+    change_color_correction(0);
+    change_run_to_vblank(0);
     change_statusbar(0);
     change_auto_continue(0);
     change_auto_rtc(0);
@@ -118,6 +140,9 @@ void menu_options_init() {
     menu_new_listentry_selection(list, "Sound", LABEL_SOUND, change_sound);
     menu_new_listentry_selection(list, "Speed", LABEL_SPEED_FACTOR, change_speed_factor);
     menu_new_listentry_selection(list, "Scaling", LABEL_SCALING, change_scaling);
+    menu_new_listentry_selection(list, "Rendering", LABEL_RENDERING, change_rendering);
+    menu_new_listentry_selection(list, "Color correction", LABEL_COLOR_CORRECTION, change_color_correction);
+    menu_new_listentry_selection(list, "Run to VBlank", LABEL_RUN_TO_VBLANK, change_run_to_vblank);
     menu_new_listentry_selection(list, "Statusbar", LABEL_STATUSBAR, change_statusbar);
     menu_new_listentry_selection(list, "Auto-Continue", LABEL_AUTO_CONTINUE, change_auto_continue);
     menu_new_listentry_selection(list, "Tick RTC when ROM not loaded", LABEL_AUTO_RTC, change_auto_rtc);
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "romgen/romgen.h"
+
+/*
+    Writes synthetic ROMs to a directory, as <workload>.gb or .gbc, all
+    workloads unless some are named.
+*/
+
+static void usage(const char *name) {
+    int w;
+
+    fprintf(stderr, "Usage: %s [-o directory] [workload...]\nWorkloads:", name);
+    for(w = 0; w < ROMGEN_NUM_WORKLOADS; w++) {
+        fprintf(stderr, " %s", ROMGEN_WORKLOAD_NAMES[w]);
+    }
+    fprintf(stderr, "\n");
+}
+
+static int write_rom(const char *dir, int workload) {
+    char path[4096];
+    uint8_t *rom;
+    size_t size;
+    FILE *file;
+    int written;
+
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, ROMGEN_WORKLOAD_NAMES[workload], romgen_is_cgb(workload) ? "gbc" : "gb");
+
+    file = fopen(path, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open '%s'\n", path);
+        return 0;
+    }
+
+    rom = romgen_build(workload, &size);
+    written = fwrite(rom, 1, size, file) == size;
+    free(rom);
+    fclose(file);
+
+    if(!written) {
+        fprintf(stderr, "Failed to write '%s'\n", path);
+        return 0;
+    }
+
+    printf("%s\n", path);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = ".";
+    int opt, w, ok = 1;
+
+    while((opt = getopt(argc, argv, "o:")) != -1) {
+        switch(opt) {
+            case 'o': dir = optarg; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if(optind == argc) {
+        for(w = 0; w < ROMGEN_NUM_WORKLOADS; w++) {
+            ok = write_rom(dir, w) && ok;
+        }
+    }
+    for(; optind < argc; optind++) {
+        w = romgen_workload(argv[optind]);
+        if(w < 0) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        ok = write_rom(dir, w) && ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,623 @@
+#include "romgen.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Every program runs from bank 0 and shares its layout: Code from 0x150,
+    tile data, tables and palettes from 0x1000. Banked workloads fill the
+    other banks with data only. Programs are assembled by hand, opcodes
+    are commented with their mnemonic. Labels are plain offsets into the
+    image, jumps back take the label, jumps forward are patched later.
+
+    Not reentrant, build ROMs on one thread.
+*/
+
+#define CODE    0x0150
+#define TILES   0x1000 // 256 tiles
+#define SINE    0x2000 // 256 bytes, 0x80 +- 0x7F
+#define PALS    0x2100 // 64 bytes BG, 64 bytes OBJ palettes
+#define OAMS    0x2200 // 3 OAM tables, 0x100 apart
+#define WAVES   0x2500 // 4 waves of 16 bytes
+#define DMA     0x2540 // OAM DMA routine, copied to HRAM
+
+#define HRAM_DMA    0xFF80
+#define HRAM_FRAME  0x90 // Frame counter, ldh offset
+#define HRAM_RESULT 0x91 // Two bytes of results the main loop publishes
+
+#define OP(...) emit((const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+#define LO(x) ((x) & 0xFF)
+#define HI(x) (((x) >> 8) & 0xFF)
+
+// Condition opcodes of JR
+#define JR    0x18
+#define JR_NZ 0x20
+#define JR_Z  0x28
+#define JR_NC 0x30
+#define JR_C  0x38
+
+typedef struct {
+    const char *title;
+    uint8_t cgb, type, romsize, ramsize;
+    void (*program)();
+    void (*banks)();
+} workload_t;
+
+const char *ROMGEN_WORKLOAD_NAMES[ROMGEN_NUM_WORKLOADS] = {"alu", "mbc", "sprites", "raster", "dma", "apu"};
+
+static const uint8_t LOGO[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
+static uint8_t *rom;
+static size_t rom_size;
+static int pc;
+static uint32_t seed;
+
+static void emit(const uint8_t *bytes, int n) {
+    assert(pc + n <= TILES);
+    memcpy(&rom[pc], bytes, n);
+    pc += n;
+}
+
+// xorshift32, so the data doesn't depend on the C library
+static uint8_t random_byte() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed >> 24;
+}
+
+static int label() {
+    return pc;
+}
+
+static void jr_back(uint8_t op, int target) {
+    int offset = target - (pc + 2);
+
+    assert(offset >= -128);
+    OP(op, (uint8_t)offset);
+}
+
+static int jr_forward(uint8_t op) {
+    int from = pc;
+
+    OP(op, 0x00);
+    return from;
+}
+
+static void resolve(int from) {
+    int offset = pc - (from + 2);
+
+    assert(offset <= 127);
+    rom[from + 1] = offset;
+}
+
+static void call(int adr) {
+    OP(0xCD, LO(adr), HI(adr)); // call adr
+}
+
+static int call_forward() {
+    int from = pc;
+
+    call(0x0000);
+    return from;
+}
+
+static void resolve_call(int from) {
+    rom[from + 1] = LO(pc);
+    rom[from + 2] = HI(pc);
+}
+
+static void vector(int adr, int handler) {
+    rom[adr + 0] = 0xC3; // jp handler
+    rom[adr + 1] = LO(handler);
+    rom[adr + 2] = HI(handler);
+}
+
+// ldh (reg),val
+static void write_io(uint8_t reg, uint8_t val) {
+    OP(0x3E, val, 0xE0, reg); // ld a,val; ldh (reg),a
+}
+
+static void copy(int dst, int src, int len) {
+    int l;
+
+    OP(0x21, LO(dst), HI(dst), 0x11, LO(src), HI(src), 0x01, LO(len), HI(len)); // ld hl,dst; ld de,src; ld bc,len
+    l = label();
+    OP(0x1A, 0x22, 0x13, 0x0B, 0x78, 0xB1); // ld a,(de); ld (hl+),a; inc de; dec bc; ld a,b; or c
+    jr_back(JR_NZ, l);
+}
+
+// Writes (n * step) & mask for n = 0, 1, ...
+static void fill(int dst, int len, uint8_t step, uint8_t mask) {
+    int l;
+
+    OP(0x21, LO(dst), HI(dst), 0x01, LO(len), HI(len), 0x16, 0x00); // ld hl,dst; ld bc,len; ld d,0
+    l = label();
+    OP(0x7A, 0xE6, mask, 0x22); // ld a,d; and mask; ld (hl+),a
+    OP(0x7A, 0xC6, step, 0x57); // ld a,d; add step; ld d,a
+    OP(0x0B, 0x78, 0xB1); // dec bc; ld a,b; or c
+    jr_back(JR_NZ, l);
+}
+
+static void write_palettes(uint8_t index_reg, uint8_t data_reg, int src) {
+    int l;
+
+    write_io(index_reg, 0x80);
+    OP(0x21, LO(src), HI(src), 0x06, 64); // ld hl,src; ld b,64
+    l = label();
+    OP(0x2A, 0xE0, data_reg, 0x05); // ld a,(hl+); ldh (data_reg),a; dec b
+    jr_back(JR_NZ, l);
+}
+
+/*
+    Waits for VBlank, switches the LCD off, loads tiles, maps and
+    palettes, clears OAM and the HRAM variables. The LCD stays off.
+*/
+static void init_video(int cgb) {
+    int l;
+
+    OP(0xF3, 0x31, 0xFE, 0xFF); // di; ld sp,0xFFFE
+    l = label();
+    OP(0xF0, 0x44, 0xFE, 0x90); // ldh a,(LY); cp 144
+    jr_back(JR_NZ, l);
+    write_io(0x40, 0x00);
+
+    copy(0x8000, TILES, 0x1000);
+    fill(0x9800, 0x800, 7, 0xFF);
+    if(cgb) {
+        write_io(0x4F, 0x01);
+        copy(0x8000, TILES + 0x800, 0x800);
+        copy(0x8800, TILES, 0x800);
+        fill(0x9800, 0x800, 13, 0x2F); // Palette, tile bank and X flip
+        write_io(0x4F, 0x00);
+        write_palettes(0x68, 0x69, PALS);
+        write_palettes(0x6A, 0x6B, PALS + 64);
+    }
+    write_io(0x47, 0xE4);
+    write_io(0x48, 0xD2);
+    write_io(0x49, 0x1B);
+    fill(0xFE00, 160, 0, 0x00);
+
+    OP(0xAF, 0xE0, HRAM_FRAME, 0xE0, HRAM_RESULT, 0xE0, HRAM_RESULT + 1); // xor a; ldh (frame),a; ldh (result),a; ldh (result+1),a
+}
+
+// Switches the LCD on and enables the interrupts
+static void start(uint8_t lcdc, uint8_t stat, uint8_t ie) {
+    write_io(0x41, stat);
+    write_io(0x40, lcdc);
+    OP(0xAF, 0xE0, 0x0F); // xor a; ldh (IF),a
+    write_io(0xFF, ie);
+    OP(0xFB); // ei
+}
+
+// start(), then halts forever, the interrupt handlers do the work
+static void run(uint8_t lcdc, uint8_t stat, uint8_t ie) {
+    int l;
+
+    start(lcdc, stat, ie);
+    l = label();
+    OP(0x76, 0x00); // halt; nop
+    jr_back(JR, l);
+}
+
+// frame++, leaves it in a
+static void count_frame() {
+    OP(0xF0, HRAM_FRAME, 0x3C, 0xE0, HRAM_FRAME); // ldh a,(frame); inc a; ldh (frame),a
+}
+
+/*
+    A 16 bit xorshift in hl, every value branches into either an 8x8 bit
+    shift-and-add multiplication or BCD arithmetic, both accumulating into
+    de. The VBlank handler writes the accumulator to the map.
+*/
+static void program_alu() {
+    int inner, even, next, mul8, l, skip, vblank;
+
+    init_video(0);
+    start(0x91, 0x00, 0x01);
+    OP(0x21, 0xE1, 0xAC, 0x11, 0x00, 0x00); // ld hl,0xACE1; ld de,0
+
+    l = label();
+    OP(0x06, 64); // ld b,64
+    inner = label();
+    OP(0x7C, 0x1F, 0x7D, 0x1F, 0xAC, 0x67); // ld a,h; rra; ld a,l; rra; xor h; ld h,a
+    OP(0x7D, 0x1F, 0x7C, 0x1F, 0xAD, 0x6F); // ld a,l; rra; ld a,h; rra; xor l; ld l,a
+    OP(0xAC, 0x67); // xor h; ld h,a
+    OP(0xCB, 0x45); // bit 0,l
+    even = jr_forward(JR_Z);
+    OP(0x7D, 0x4C); // ld a,l; ld c,h
+    mul8 = call_forward();
+    next = jr_forward(JR);
+    resolve(even);
+    OP(0x7D, 0xCB, 0x37, 0xAC, 0x27, 0x4F); // ld a,l; swap a; xor h; daa; ld c,a
+    OP(0x7B, 0x89, 0x5F, 0x7A, 0xCE, 0x00, 0x57); // ld a,e; adc c; ld e,a; ld a,d; adc 0; ld d,a
+    resolve(next);
+    OP(0x05); // dec b
+    jr_back(JR_NZ, inner);
+    OP(0x7A, 0xE0, HRAM_RESULT, 0x7B, 0xE0, HRAM_RESULT + 1); // ld a,d; ldh (result),a; ld a,e; ldh (result+1),a
+    jr_back(JR, l);
+
+    // mul8: de += a * c, preserves bc and hl
+    resolve_call(mul8);
+    OP(0xC5, 0xE5, 0x21, 0x00, 0x00, 0x06, 0x00); // push bc; push hl; ld hl,0; ld b,0
+    l = label();
+    OP(0xCB, 0x3F); // srl a
+    skip = jr_forward(JR_NC);
+    OP(0x09); // add hl,bc
+    resolve(skip);
+    OP(0xCB, 0x21, 0xCB, 0x10, 0xB7); // sla c; rl b; or a
+    jr_back(JR_NZ, l);
+    OP(0x19, 0x54, 0x5D); // add hl,de; ld d,h; ld e,l
+    OP(0xE1, 0xC1, 0xC9); // pop hl; pop bc; ret
+
+    vblank = label();
+    OP(0xF5, 0xE5); // push af; push hl
+    count_frame();
+    OP(0x6F, 0x26, 0x98); // ld l,a; ld h,0x98
+    OP(0xF0, HRAM_RESULT, 0x77, 0x2C); // ldh a,(result); ld (hl),a; inc l
+    OP(0xF0, HRAM_RESULT + 1, 0x77); // ldh a,(result+1); ld (hl),a
+    OP(0xF0, 0x43, 0x3C, 0xE0, 0x43); // ldh a,(SCX); inc a; ldh (SCX),a
+    OP(0xE1, 0xF1, 0xD9); // pop hl; pop af; reti
+    vector(0x40, vblank);
+}
+
+/*
+    Sums 32 bytes of every ROM bank in turn and stores the sums in the RAM
+    bank selected along with it. The VBlank handler copies the current RAM
+    bank's sums to the map.
+*/
+#define MBC_ROMBANKS 32
+
+static void program_mbc() {
+    int vblank, outer, banks, sum, l;
+
+    init_video(0);
+    start(0x91, 0x00, 0x01);
+    OP(0x3E, 0x0A, 0xEA, 0x00, 0x00); // ld a,0x0A; ld (0x0000),a
+
+    outer = label();
+    OP(0x0E, 0x01); // ld c,1
+    banks = label();
+    OP(0x79, 0xEA, 0x00, 0x20); // ld a,c; ld (0x2000),a
+    OP(0xE6, 0x03, 0xEA, 0x00, 0x40); // and 3; ld (0x4000),a
+    OP(0x26, 0x40, 0x69, 0x06, 32, 0x51); // ld h,0x40; ld l,c; ld b,32; ld d,c
+    sum = label();
+    OP(0x2A, 0x82, 0x57, 0x05); // ld a,(hl+); add d; ld d,a; dec b
+    jr_back(JR_NZ, sum);
+    OP(0x26, 0xA0, 0x69, 0x72); // ld h,0xA0; ld l,c; ld (hl),d
+    OP(0x0C, 0x79, 0xFE, MBC_ROMBANKS); // inc c; ld a,c; cp MBC_ROMBANKS
+    jr_back(JR_NZ, banks);
+    jr_back(JR, outer);
+
+    vblank = label();
+    OP(0xF5, 0xC5, 0xD5, 0xE5); // push af; push bc; push de; push hl
+    count_frame();
+    OP(0xE6, 0x07, 0xCB, 0x37, 0x87, 0x5F, 0x16, 0x98); // and 7; swap a; add a; ld e,a; ld d,0x98
+    OP(0x21, 0x00, 0xA0, 0x06, 32); // ld hl,0xA000; ld b,32
+    l = label();
+    OP(0x2A, 0x12, 0x13, 0x05); // ld a,(hl+); ld (de),a; inc de; dec b
+    jr_back(JR_NZ, l);
+    OP(0xE1, 0xD1, 0xC1, 0xF1, 0xD9); // pop hl; pop de; pop bc; pop af; reti
+    vector(0x40, vblank);
+}
+
+static void banks_mbc() {
+    int bank, i;
+
+    for(bank = 1; bank < MBC_ROMBANKS; bank++) {
+        for(i = 0; i < 0x4000; i++) {
+            rom[bank * 0x4000 + i] = bank * 0x3B + i * 7 + (i >> 8);
+        }
+    }
+}
+
+/*
+    Four rows of ten 8x16 objects cover 64 lines. Three OAM tables, moved
+    in by OAM DMA at VBlank and at LY 62 and 126, stack them over the
+    whole screen, so every line has the maximum of 10 objects. VBlank
+    moves and animates all objects.
+*/
+static void program_sprites() {
+    int vblank, stat, tables, objs, skip, second;
+
+    init_video(1);
+    copy(0xC000, OAMS, 0x300);
+    copy(HRAM_DMA, DMA, 8);
+    write_io(0x45, 62);
+    run(0x97, 0x40, 0x03);
+
+    vblank = label();
+    OP(0xF5, 0xC5, 0xE5); // push af; push bc; push hl
+    OP(0x3E, 0xC0); // ld a,0xC0
+    call(HRAM_DMA);
+    write_io(0x45, 62);
+    count_frame();
+    OP(0xE6, 0x07, 0x0E, 0x01); // and 7; ld c,1
+    skip = jr_forward(JR_NZ);
+    OP(0x0E, 0xF9); // ld c,-7
+    resolve(skip);
+    OP(0x26, 0xC0); // ld h,0xC0
+    tables = label();
+    OP(0x2E, 0x01, 0x06, 40); // ld l,1; ld b,40
+    objs = label();
+    OP(0x7E, 0x81, 0x22); // ld a,(hl); add c; ld (hl+),a
+    OP(0x34, 0x34, 0x2C, 0x2C, 0x2C); // inc (hl); inc (hl); inc l; inc l; inc l
+    OP(0x05); // dec b
+    jr_back(JR_NZ, objs);
+    OP(0x24, 0x7C, 0xFE, 0xC3); // inc h; ld a,h; cp 0xC3
+    jr_back(JR_NZ, tables);
+    OP(0xE1, 0xC1, 0xF1, 0xD9); // pop hl; pop bc; pop af; reti
+    vector(0x40, vblank);
+
+    stat = label();
+    OP(0xF5, 0xF0, 0x45, 0xFE, 62); // push af; ldh a,(LYC); cp 62
+    second = jr_forward(JR_NZ);
+    OP(0x3E, 0xC1); // ld a,0xC1
+    call(HRAM_DMA);
+    write_io(0x45, 126);
+    OP(0xF1, 0xD9); // pop af; reti
+    resolve(second);
+    OP(0x3E, 0xC2); // ld a,0xC2
+    call(HRAM_DMA);
+    write_io(0x45, 62);
+    OP(0xF1, 0xD9); // pop af; reti
+    vector(0x48, stat);
+}
+
+/*
+    In every HBlank: SCX and SCY from the sine table at LY + frame, the
+    DMG palette rotated and one CGB BG color rewritten.
+*/
+static void program_raster() {
+    int vblank, stat;
+
+    init_video(1);
+    run(0x91, 0x08, 0x03);
+
+    vblank = label();
+    OP(0xF5); // push af
+    count_frame();
+    OP(0xF1, 0xD9); // pop af; reti
+    vector(0x40, vblank);
+
+    stat = label();
+    OP(0xF5, 0xE5); // push af; push hl
+    OP(0xF0, 0x44, 0x21, HRAM_FRAME, 0xFF, 0x86); // ldh a,(LY); ld hl,frame; add (hl)
+    OP(0x6F, 0x26, HI(SINE), 0x7E, 0xE0, 0x43); // ld l,a; ld h,HI(SINE); ld a,(hl); ldh (SCX),a
+    OP(0x7D, 0xC6, 0x40, 0x6F, 0x7E, 0xCB, 0x3F, 0xCB, 0x3F, 0xE0, 0x42); // ld a,l; add 0x40; ld l,a; ld a,(hl); srl a; srl a; ldh (SCY),a
+    OP(0xF0, 0x47, 0x07, 0x07, 0xE0, 0x47); // ldh a,(BGP); rlca; rlca; ldh (BGP),a
+    OP(0x7D, 0xE6, 0x3E, 0xF6, 0x80, 0xE0, 0x68); // ld a,l; and 0x3E; or 0x80; ldh (BCPS),a
+    OP(0x7E, 0xE0, 0x69, 0x7D, 0xE0, 0x69); // ld a,(hl); ldh (BCPD),a; ld a,l; ldh (BCPD),a
+    OP(0xE1, 0xF1, 0xD9); // pop hl; pop af; reti
+    vector(0x48, stat);
+}
+
+/*
+    Streams tiles from the ROM banks into both VRAM banks: At VBlank a
+    GDMA of 0x600 bytes to 0x8000, then an HDMA of 0x800 bytes to 0x8800
+    that moves 16 bytes in each HBlank of the next frame.
+*/
+#define DMA_ROMBANKS 8
+
+static void program_dma() {
+    int vblank, skip;
+
+    init_video(1);
+    run(0x91, 0x00, 0x01);
+
+    vblank = label();
+    OP(0xF5, 0xE5); // push af; push hl
+    count_frame();
+    OP(0x6F, 0xE6, DMA_ROMBANKS - 1); // ld l,a; and DMA_ROMBANKS-1
+    skip = jr_forward(JR_NZ);
+    OP(0x3C); // inc a
+    resolve(skip);
+    OP(0xEA, 0x00, 0x20); // ld (0x2000),a
+    OP(0x7D, 0xE6, 0x01, 0xE0, 0x4F); // ld a,l; and 1; ldh (VBK),a
+
+    OP(0x7D, 0xE6, 0x0F, 0x87, 0xC6, 0x40, 0xE0, 0x51); // ld a,l; and 0x0F; add a; add 0x40; ldh (HDMA1),a
+    OP(0xAF, 0xE0, 0x52); // xor a; ldh (HDMA2),a
+    write_io(0x53, 0x80);
+    OP(0xAF, 0xE0, 0x54); // xor a; ldh (HDMA4),a
+    write_io(0x55, 0x5F);
+
+    OP(0x7D, 0xE6, 0x0F, 0x87, 0xC6, 0x46, 0xE0, 0x51); // ld a,l; and 0x0F; add a; add 0x46; ldh (HDMA1),a
+    OP(0xAF, 0xE0, 0x52); // xor a; ldh (HDMA2),a
+    write_io(0x53, 0x88);
+    OP(0xAF, 0xE0, 0x54); // xor a; ldh (HDMA4),a
+    write_io(0x55, 0xFF);
+    OP(0xE1, 0xF1, 0xD9); // pop hl; pop af; reti
+    vector(0x40, vblank);
+}
+
+static void banks_dma() {
+    int bank, i;
+
+    for(bank = 1; bank < DMA_ROMBANKS; bank++) {
+        for(i = 0; i < 0x4000; i++) {
+            rom[bank * 0x4000 + i] = random_byte() & (i & 1 ? 0xF0 | bank : 0xFF);
+        }
+    }
+}
+
+/*
+    Every 8th frame all channels are retriggered with new frequencies, duty
+    cycles and noise parameters, and another wave is loaded. Channel 1 is
+    swept and its frequency changes every frame. At LY 72 panning and
+    volume change. NR52 is written to the map.
+*/
+static void program_apu() {
+    int vblank, stat, skip, l;
+
+    init_video(0);
+    write_io(0x26, 0x80);
+    write_io(0x24, 0x77);
+    write_io(0x25, 0xFF);
+    write_io(0x1A, 0x00);
+    copy(0xFF30, WAVES, 16);
+    write_io(0x45, 72);
+    run(0x91, 0x40, 0x03);
+
+    vblank = label();
+    OP(0xF5, 0xC5, 0xE5); // push af; push bc; push hl
+    count_frame();
+    OP(0x47, 0x26, HI(SINE)); // ld b,a; ld h,HI(SINE)
+    OP(0xE6, 0x07); // and 7
+    skip = jr_forward(JR_NZ);
+
+    write_io(0x10, 0x15);
+    OP(0x78, 0x07, 0x07, 0x07, 0xE6, 0xC0, 0xF6, 0x10, 0xE0, 0x11); // ld a,b; rlca; rlca; rlca; and 0xC0; or 0x10; ldh (NR11),a
+    write_io(0x12, 0xF3);
+    OP(0x68, 0x7E, 0xE0, 0x13); // ld l,b; ld a,(hl); ldh (NR13),a
+    OP(0x78, 0xCB, 0x37, 0x0F, 0xE6, 0x07, 0xF6, 0xC0, 0xE0, 0x14); // ld a,b; swap a; rrca; and 7; or 0xC0; ldh (NR14),a
+
+    OP(0x78, 0xE6, 0xC0, 0xE0, 0x16); // ld a,b; and 0xC0; ldh (NR21),a
+    write_io(0x17, 0xA5);
+    OP(0x78, 0xC6, 0x40, 0x6F, 0x7E, 0xE0, 0x18); // ld a,b; add 0x40; ld l,a; ld a,(hl); ldh (NR23),a
+    write_io(0x19, 0x86);
+
+    write_io(0x1A, 0x00);
+    OP(0x78, 0xE6, 0x30, 0x6F, 0x26, HI(WAVES), 0x0E, 0x30); // ld a,b; and 0x30; ld l,a; ld h,HI(WAVES); ld c,0x30
+    l = label();
+    OP(0x2A, 0xE2, 0x0C, 0x79, 0xFE, 0x40); // ld a,(hl+); ld (c),a; inc c; ld a,c; cp 0x40
+    jr_back(JR_NZ, l);
+    write_io(0x1A, 0x80);
+    write_io(0x1B, 0x20);
+    write_io(0x1C, 0x20);
+    OP(0x26, HI(SINE), 0x78, 0xC6, 0x80, 0x6F, 0x7E, 0xE0, 0x1D); // ld h,HI(SINE); ld a,b; add 0x80; ld l,a; ld a,(hl); ldh (NR33),a
+    write_io(0x1E, 0x87);
+
+    write_io(0x20, 0x10);
+    write_io(0x21, 0xF1);
+    OP(0x78, 0xE6, 0x77, 0xE0, 0x22); // ld a,b; and 0x77; ldh (NR43),a
+    write_io(0x23, 0xC0);
+    resolve(skip);
+
+    OP(0x78, 0x87, 0x87, 0x6F, 0x7E, 0xE0, 0x13); // ld a,b; add a; add a; ld l,a; ld a,(hl); ldh (NR13),a
+    OP(0xF0, 0x26, 0x68, 0x26, 0x98, 0x77); // ldh a,(NR52); ld l,b; ld h,0x98; ld (hl),a
+    OP(0xE1, 0xC1, 0xF1, 0xD9); // pop hl; pop bc; pop af; reti
+    vector(0x40, vblank);
+
+    stat = label();
+    OP(0xF5); // push af
+    OP(0xF0, 0x25, 0x07, 0xE0, 0x25); // ldh a,(NR51); rlca; ldh (NR51),a
+    OP(0xF0, 0x24, 0xEE, 0x22, 0xE0, 0x24); // ldh a,(NR50); xor 0x22; ldh (NR50),a
+    OP(0xF1, 0xD9); // pop af; reti
+    vector(0x48, stat);
+}
+
+static const workload_t workloads[ROMGEN_NUM_WORKLOADS] = {
+    {"SYNTH ALU",  0x00, 0x00, 0x00, 0x00, program_alu, NULL},
+    {"SYNTH MBC",  0x00, 0x1A, 0x04, 0x03, program_mbc, banks_mbc},
+    {"SYNTH OBJ",  0x80, 0x00, 0x00, 0x00, program_sprites, NULL},
+    {"SYNTH RAST", 0x80, 0x00, 0x00, 0x00, program_raster, NULL},
+    {"SYNTH DMA",  0xC0, 0x19, 0x02, 0x00, program_dma, banks_dma},
+    {"SYNTH APU",  0x00, 0x00, 0x00, 0x00, program_apu, NULL}
+};
+
+static void build_data() {
+    int i, t, row, x;
+
+    for(i = 0; i < 0x1000; i++) {
+        t = i / 16;
+        row = (i / 2) % 8;
+        rom[TILES + i] = i & 1 ? (t & 1 ? 0xFF >> row : 0x3C ^ (t << 1)) : (0xF0 >> (row % 4)) ^ (t * 0x11);
+    }
+
+    // Parabolas, so the table doesn't depend on libm
+    for(i = 0; i < 256; i++) {
+        x = i & 127;
+        x = x * (128 - x) / 32;
+        rom[SINE + i] = i < 128 ? 0x80 + (x > 127 ? 127 : x) : 0x80 - (x > 127 ? 127 : x);
+    }
+
+    for(i = 0; i < 128; i++) {
+        rom[PALS + i] = random_byte();
+    }
+
+    for(t = 0; t < 3; t++) {
+        for(i = 0; i < 40; i++) {
+            uint8_t *obj = &rom[OAMS + t * 0x100 + i * 4];
+
+            obj[0] = 16 + t * 64 + (i / 10) * 16;
+            obj[1] = 8 + (i % 10) * 16;
+            obj[2] = (t * 40 + i) * 2;
+            obj[3] = (i & 7) | (i & 1 ? 0x20 : 0x00) | (i % 3 == 0 ? 0x40 : 0x00) | (i & 4 ? 0x10 : 0x00) | (i % 7 == 0 ? 0x80 : 0x00);
+        }
+    }
+
+    for(i = 0; i < 64; i++) {
+        rom[WAVES + i] = (i & 0x30) == 0x00 ? i * 0x11 : (i & 0x30) == 0x10 ? (i & 8 ? 0xFF : 0x00) : random_byte();
+    }
+
+    // ldh (DMA),a; ld a,40; dec a; jr nz,-3; ret
+    memcpy(&rom[DMA], (const uint8_t[]){0xE0, 0x46, 0x3E, 0x28, 0x3D, 0x20, 0xFD, 0xC9}, 8);
+}
+
+static void build_header(const workload_t *w) {
+    uint8_t check;
+    uint16_t global;
+    size_t i;
+
+    memcpy(&rom[0x100], (const uint8_t[]){0x00, 0xC3, LO(CODE), HI(CODE)}, 4); // nop; jp CODE
+    memcpy(&rom[0x104], LOGO, sizeof(LOGO));
+    strncpy((char*)&rom[0x134], w->title, 11);
+    rom[0x143] = w->cgb;
+    rom[0x147] = w->type;
+    rom[0x148] = w->romsize;
+    rom[0x149] = w->ramsize;
+    rom[0x14A] = 0x01;
+
+    for(check = 0, i = 0x134; i <= 0x14C; i++) {
+        check = check - rom[i] - 1;
+    }
+    rom[0x14D] = check;
+
+    for(global = 0, i = 0; i < rom_size; i++) {
+        global += i == 0x14E || i == 0x14F ? 0 : rom[i];
+    }
+    rom[0x14E] = HI(global);
+    rom[0x14F] = LO(global);
+}
+
+// -1 if there is no workload of that name
+int romgen_workload(const char *name) {
+    int w;
+
+    for(w = 0; w < ROMGEN_NUM_WORKLOADS; w++) {
+        if(strcmp(name, ROMGEN_WORKLOAD_NAMES[w]) == 0) {
+            return w;
+        }
+    }
+
+    return -1;
+}
+
+int romgen_is_cgb(int workload) {
+    return workloads[workload].cgb & 0x80;
+}
+
+// The image is malloc()ed, the caller frees it
+uint8_t *romgen_build(int workload, size_t *size) {
+    const workload_t *w = &workloads[workload];
+
+    rom_size = 0x8000 << w->romsize;
+    rom = calloc(rom_size, 1);
+    seed = 0x2545F491;
+
+    build_data();
+    if(w->banks != NULL) {
+        w->banks();
+    }
+    pc = CODE;
+    w->program();
+    build_header(w);
+
+    *size = rom_size;
+    return rom;
+}
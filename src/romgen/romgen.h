@@ -0,0 +1,27 @@
+#ifndef ROMGEN_ROMGEN_H
+#define ROMGEN_ROMGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Synthetic ROMs for benchmarks and regression runs: Small, valid images
+    that each keep one subsystem of the core busy, built in memory and free
+    to redistribute. The same workload always builds to the same bytes.
+*/
+
+#define ROMGEN_ALU     0 // ALU and branch heavy loops, DMG
+#define ROMGEN_MBC     1 // MBC5 ROM and RAM bank switching, DMG
+#define ROMGEN_SPRITES 2 // 10 8x16 objects on every line, multiplexed by OAM DMA, CGB
+#define ROMGEN_RASTER  3 // SCX, SCY and palettes rewritten in every HBlank, CGB
+#define ROMGEN_DMA     4 // GDMA in VBlank and HDMA over the frame from switched banks, CGB only
+#define ROMGEN_APU     5 // All four channels retriggered and swept, DMG
+#define ROMGEN_NUM_WORKLOADS 6
+
+extern const char *ROMGEN_WORKLOAD_NAMES[ROMGEN_NUM_WORKLOADS];
+
+int romgen_workload(const char *name);
+int romgen_is_cgb(int workload);
+uint8_t *romgen_build(int workload, size_t *size);
+
+#endif
@@ -0,0 +1,78 @@
+#include "sys/sys.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Backend without video, audio or input devices. Frames and samples stay
+    in lcd and sys.sound_buf for the embedder to fetch.
+*/
+
+#define NULL_SOUND_FREQ 44100
+#define NULL_SOUND_BUF_SIZE 4096
+
+THREAD_LOCAL sys_t sys;
+
+void sys_init(int argc, const char** argv) {
+    memset(&sys, 0x00, sizeof(sys));
+
+    sys.sound_freq = NULL_SOUND_FREQ;
+    sys.sound_sample_size = 2;
+    sys.sound_buf_size = NULL_SOUND_BUF_SIZE;
+    sys.sound_buf = malloc(sys.sound_buf_size * sys.sound_sample_size * 2);
+    sys.quantum_length = 17556;
+    sys.run_to_vblank = 1;
+}
+
+void sys_reset() {
+    sys.sound_buf_start = 0;
+    sys.sound_buf_end = 0;
+    sys.ticks = 0;
+    sys.invoke_cc = 0;
+}
+
+void sys_close() {
+    free(sys.sound_buf);
+    sys.sound_buf = NULL;
+}
+
+void sys_pause() {
+}
+
+void sys_continue() {
+}
+
+void sys_begin() {
+}
+
+void sys_delay(int ticks) {
+}
+
+void sys_invoke() {
+}
+
+void sys_fb_ready() {
+    sys.fb_ready = 1;
+}
+
+int sys_skip_frame() {
+    return 0;
+}
+
+void sys_play_audio(int on) {
+}
+
+void sys_lock_audiobuf() {
+}
+
+void sys_unlock_audiobuf() {
+}
+
+void sys_handle_events(void (*input_handle)(int, int)) {
+}
+
+void sys_new_performance_info() {
+}
+
+void sys_set_scalingmode(int mode) {
+    sys.scalingmode = mode;
+}
@@ -1,5 +1,4 @@
 #include "audio.h"
-#include "core/sound.h"
 #include "core/moo.h"
 #include "sys/sys.h"
 #include <assert.h>
@@ -7,6 +6,10 @@
 
 static SDL_mutex *mutex;
 
+// The audio thread has no emulator of its own, it serves the one that opened the device
+static sys_t *audio_sys;
+static const moo_t *audio_moo;
+
 
 void sys_lock_audiobuf() {
     SDL_mutexP(mutex);
@@ -18,55 +21,50 @@ void sys_unlock_audiobuf() {
 
 static u16 get_available_samples() {
     u16 r;
-    if(sys.sound_buf_start > sys.sound_buf_end) {
-        r = sys.sound_buf_size - (sys.sound_buf_start - sys.sound_buf_end) + 1;
+    if(audio_sys->sound_buf_start > audio_sys->sound_buf_end) {
+        r = audio_sys->sound_buf_size - (audio_sys->sound_buf_start - audio_sys->sound_buf_end) + 1;
     }
     else {
-        r = sys.sound_buf_end - sys.sound_buf_start;
+        r = audio_sys->sound_buf_end - audio_sys->sound_buf_start;
     }
 
     return r;
 }
 
 static void handout_buf(void *_unused, Uint8 *stream, int length) {
-    u16 requested_samples = length / (sys.sound_sample_size * 2);
-    u16 available_samples;
+    u16 requested_samples = length / (audio_sys->sound_sample_size * 2);
     u16 served_samples;
 
     sys_lock_audiobuf();
 
-    if(!sys.sound_on || (~moo.state & MOO_ROM_RUNNING_BIT)) {
+    if(!audio_sys->sound_on || (~audio_moo->state & MOO_ROM_RUNNING_BIT)) {
+        memset(stream, 0x00, length);
+    }
+    else if(get_available_samples() < requested_samples) {
+        // The emulator is behind and mixes on its own thread only, play silence until it caught up
         memset(stream, 0x00, length);
+        sys_unlock_audiobuf();
+        return;
     }
     else {
-#ifdef DEBUG
-        if(get_available_samples() < requested_samples) {
-      //      printf("WARNING: Sound buffer underrun\n");
-        }
-#endif
-
-        while((available_samples = get_available_samples()) < requested_samples) {
-            sound_mix();
-        }
-
-        if(sys.sound_buf_start > sys.sound_buf_end) {
-            served_samples = sys.sound_buf_size - sys.sound_buf_start;
+        if(audio_sys->sound_buf_start > audio_sys->sound_buf_end) {
+            served_samples = audio_sys->sound_buf_size - audio_sys->sound_buf_start;
             if(served_samples >= requested_samples) {
-                memcpy(stream, &sys.sound_buf[sys.sound_buf_start*2*2], length);
+                memcpy(stream, &audio_sys->sound_buf[audio_sys->sound_buf_start*2*2], length);
             }
             else {
-                u16 bytes = served_samples * sys.sound_sample_size * 2;
-                memcpy(&stream[0], &sys.sound_buf[sys.sound_buf_start*2*2], bytes);
-                memcpy(&stream[bytes], &sys.sound_buf[0], (requested_samples - served_samples) * sys.sound_sample_size * 2);
+                u16 bytes = served_samples * audio_sys->sound_sample_size * 2;
+                memcpy(&stream[0], &audio_sys->sound_buf[audio_sys->sound_buf_start*2*2], bytes);
+                memcpy(&stream[bytes], &audio_sys->sound_buf[0], (requested_samples - served_samples) * audio_sys->sound_sample_size * 2);
             }
         }
         else {
-            memcpy(stream, &sys.sound_buf[sys.sound_buf_start*2*2], length);
+            memcpy(stream, &audio_sys->sound_buf[audio_sys->sound_buf_start*2*2], length);
         }
     }
 
-    sys.sound_buf_start += requested_samples;
-    sys.sound_buf_start %= sys.sound_buf_size;
+    audio_sys->sound_buf_start += requested_samples;
+    audio_sys->sound_buf_start %= audio_sys->sound_buf_size;
 
     sys_unlock_audiobuf();
 }
@@ -74,6 +72,9 @@ static void handout_buf(void *_unused, Uint8 *stream, int length) {
 void audio_init() {
     SDL_AudioSpec format;
 
+    audio_sys = &sys;
+    audio_moo = &moo;
+
     format.freq = sys.sound_freq;
     format.format = AUDIO_S16;
     format.channels = 2;
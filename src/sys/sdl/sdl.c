@@ -19,6 +19,7 @@
 #include "util/speed.h"
 #include "util/framerate.h"
 #include "util/performance.h"
+#include "util/pacing.h"
 #include "util/speed.h"
 
 #define SCALING_PROPORTIONAL 0
@@ -26,7 +27,7 @@
 #define SCALING_PROPORTIONAL_FULL 2
 #define SCALING_NONE 3
 
-sys_t sys;
+THREAD_LOCAL sys_t sys;
 
 static SDL_Surface *statuslabel;
 
@@ -40,9 +41,7 @@ void sys_init(int argc, const char** argv) {
     sys.sound_sample_size = 2;
     sys.sound_buf_size = 4096;
     sys.sound_buf = malloc(sys.sound_buf_size * sys.sound_sample_size * 2);
-    sys.quantum_length = 1000;
-    sys.bits_per_pixel = 16;
-    sys.bytes_per_pixel = 2;
+    sys.quantum_length = PERFORMANCE_MIN_QUANTUM;
     sys.show_statusbar = 0;
     sys.auto_continue = SYS_AUTO_CONTINUE_ASK;
     sys.fb_ready = 0;
@@ -66,6 +65,10 @@ void sys_init(int argc, const char** argv) {
 
     SDL_ShowCursor(0);
 
+    // Use the depth of the display if the scalers can output it directly
+    sys.bits_per_pixel = SDL_GetVideoInfo()->vfmt->BitsPerPixel == 32 ? 32 : 16;
+    sys.bytes_per_pixel = sys.bits_per_pixel / 8;
+
     if(SDL_SetVideoMode(screen_w, screen_h, sys.bits_per_pixel, flags) == NULL) {
         moo_fatalf("Setting of SDL video-mode failed");
     }
@@ -166,11 +169,36 @@ SDL_Rect streched_scaling_area() {
 
 
 static void render() {
-    video_render(SDL_GetVideoSurface());
+    static SDL_Rect rects[LCD_HEIGHT + 1];
+    static int statusbar_shown = 0;
+    SDL_Surface *screen = SDL_GetVideoSurface();
+    int num_rects;
+
+    if(statusbar_shown != sys.show_statusbar) {
+        statusbar_shown = sys.show_statusbar;
+        video_invalidate();
+    }
+
+    num_rects = video_render(screen, rects);
     if(sys.show_statusbar) {
-        SDL_BlitSurface(statuslabel, NULL, SDL_GetVideoSurface(), NULL);
+        SDL_BlitSurface(statuslabel, NULL, screen, NULL);
+        rects[num_rects].x = 0;
+        rects[num_rects].y = 0;
+        rects[num_rects].w = statuslabel->w;
+        rects[num_rects].h = statuslabel->h;
+        num_rects++;
+    }
+
+    if(num_rects == 0) {
+        return;
+    }
+    if(screen->flags & SDL_DOUBLEBUF) {
+        SDL_Flip(screen);
+        video_flipped();
+    }
+    else {
+        SDL_UpdateRects(screen, num_rects, rects);
     }
-    SDL_Flip(SDL_GetVideoSurface());
 }
 
 void sys_delay(int ticks) {
@@ -179,6 +207,15 @@ void sys_delay(int ticks) {
 
 void sys_fb_ready() {
     sys.fb_ready = 1;
+    pacing_frame();
+}
+
+int sys_skip_frame() {
+    if(framerate_skip_next_frame()) {
+        performance.counting.skipped++;
+        return 1;
+    }
+    return 0;
 }
 
 void sys_handle_events(void (*input_handle)(int, int)) {
@@ -221,7 +258,7 @@ void sys_play_audio(int on) {
 
 void sys_new_performance_info() {
     char statusline[256];
-    snprintf(statusline, sizeof(statusline), "Skipped %i/%i frames, Slept %6.2f %%, Speed: %6.2f %%, CPU: %i Hz", performance.counters.skipped, performance.counters.frames, (float)performance.counters.slept*100/PERFORMANCE_UPDATE_PERIOD, performance.speed, cpu.freq);
+    snprintf(statusline, sizeof(statusline), "Skipped %i/%i frames, Slept %6.2f %%, Speed: %6.2f %%, CPU: %i Hz, Quantum: %i, Jitter: %.2f/%.2f/%.2f ms", performance.counters.skipped, performance.counters.frames, (float)performance.counters.slept*100/PERFORMANCE_UPDATE_PERIOD, performance.speed, cpu.freq, performance.quantum, performance.jitter_p50, performance.jitter_p95, performance.jitter_p99);
 
     SDL_FillRect(statuslabel, NULL, 0);
     stringColor(statuslabel, 0, 0, statusline, 0xaaaaaaff);
@@ -4,177 +4,189 @@
 #include "sys/sys.h"
 #include "core/moo.h"
 #include "core/lcd.h"
+#include "util/scale.h"
 
 
-static u8 *linebuf = NULL;
-static int linebuf_size = 0;
-static int acolumns_in_fbpixel_buf[160];
-static int line_length;
-static int line_byte_offset;
-static int bytes_per_pixel;
-static int bytes_per_line;
 static SDL_Rect area;
-static int rshift, gshift, bshift;
 
-static u16 dmg_palette[4];
+/*
+    Last frame presented in each buffer of the surface, to only redraw lines
+    that changed. A SDL_DOUBLEBUF surface alternates between two buffers,
+    any other uses the first only.
+*/
+static u16 presented_fb[2][144*160];
+static int redraw_all[2] = {1, 1};
+static int back; // Buffer drawn to
+static int line_changed[144];
+static SDL_Rect *rects;
+static int num_rects;
 
-sys_t sys;
-
-
-static inline u16 cgb_to_rgb(u16 cgb_color) {
-    u16 r, g, b;
-
-    r = (cgb_color >> 0) & 0x1F;
-    g = (cgb_color >> 5) & 0x1F;
-    b = (cgb_color >> 10) & 0x1F;
-
-    return (r << rshift) | (g << gshift) | (b << bshift);
-}
-
-static inline u16 dmg_to_rgb(u16 dmg_color) {
-    return dmg_palette[dmg_color];
-}
 
 static inline int alines_in_fbline(int aline, int aheight, int fbline) {
     return (((fbline + 1) * aheight) / 144) - aline;
 }
 
-static inline int acolumns_in_fbpixel(int acolumn, int awidth, int fbx) {
-    return (((fbx + 1) * awidth) / 160) - acolumn;
-}
-
-static inline void fw_render_buffer(SDL_Surface *surface, void *buf, int buflines, int y) {
-    memcpy(surface->pixels + bytes_per_line * y, buf, buflines * bytes_per_line);
-}
-
-static void render_fbline_to_buffer(int line) {
-    int fb_pixel, buf_pos, ax, ppos, fbx;
-    u16 s_color;
-    int pixels_to_set;
-
-    buf_pos = line_byte_offset;
-    fb_pixel = line * 160;
-    fbx = 0;
+static int detect_changed_lines() {
+    int line, changed;
 
-    for(ax = 0; ax < area.w; fbx++) {
-        s_color = lcd.clean_fb[fb_pixel++];
-        pixels_to_set = acolumns_in_fbpixel_buf[fbx];
-        ax += pixels_to_set;
+    for(line = 0, changed = 0; line < 144; line++) {
+        u16 buf[160];
+        const u16 *src = lcd_frame_line(lcd.clean_fb, line, buf);
+        u16 *dst = &presented_fb[back][line * 160];
 
-        for(ppos = 0; ppos < pixels_to_set; ppos++) {
-            *(u16*)&linebuf[buf_pos] = s_color;
-            buf_pos+=2;
+        line_changed[line] = redraw_all[back] || memcmp(src, dst, 160 * sizeof(*src)) != 0;
+        if(line_changed[line]) {
+            memcpy(dst, src, 160 * sizeof(*src));
+            changed++;
         }
     }
+    redraw_all[back] = 0;
+
+    return changed;
 }
 
-static void fullwidth_render(SDL_Surface *surface) {
-    int aline, buflines, fbline, alines_to_fill;
+static void add_rect(int x, int y, int w, int h) {
+    if(num_rects > 0 && rects[num_rects - 1].y + rects[num_rects - 1].h == y) {
+        rects[num_rects - 1].h += h;
+    }
+    else {
+        rects[num_rects].x = x;
+        rects[num_rects].y = y;
+        rects[num_rects].w = w;
+        rects[num_rects].h = h;
+        num_rects++;
+    }
+}
 
-    buflines = 0;
-    fbline = 0;
-    line_length = surface->w;
-    line_byte_offset = 0;
-    bytes_per_line = surface->pitch;
-    bytes_per_pixel = surface->format->BytesPerPixel;
+/*
+    Scales every changed line into its first row of the area and copies
+    that row down to the other rows the line covers.
+*/
+static void area_render(SDL_Surface *surface) {
+    int aline, fbline, alines_to_fill, l;
+    u8 *row;
 
-    for(aline = 0; aline < area.h; fbline++) {
+    for(aline = 0, fbline = 0; aline < area.h; fbline++) {
         alines_to_fill = alines_in_fbline(aline, area.h, fbline);
-        if(alines_to_fill > 0) {
-            render_fbline_to_buffer(fbline);
 
-            for(buflines = 1; alines_to_fill >= buflines * 2; buflines *= 2) {
-                memcpy(&linebuf[buflines * bytes_per_line], linebuf, buflines * bytes_per_line);
-            }
-            fw_render_buffer(surface, linebuf, buflines, aline);
-            aline += buflines;
-            if(alines_to_fill > buflines) {
-                fw_render_buffer(surface, linebuf, alines_to_fill - buflines, aline);
+        if(alines_to_fill > 0 && line_changed[fbline]) {
+            row = (u8*)surface->pixels + (area.y + aline) * surface->pitch + area.x * surface->format->BytesPerPixel;
+            scale_line(&presented_fb[back][fbline * 160], row);
+
+            for(l = 1; l < alines_to_fill; l++) {
+                memcpy(row + l * surface->pitch, row, area.w * surface->format->BytesPerPixel);
             }
-            aline += alines_to_fill - buflines;
+            add_rect(area.x, area.y + aline, area.w, alines_to_fill);
         }
+        aline += alines_to_fill;
     }
 }
 
+void video_invalidate() {
+    redraw_all[0] = 1;
+    redraw_all[1] = 1;
+}
 
-static void area_render(SDL_Surface *surface) {
-    int aline, buflines, fbline, alines_to_fill;
+// After SDL_Flip(), the other buffer is drawn to from now on
+void video_flipped() {
+    back ^= 1;
+}
 
-    buflines = 0;
-    fbline = 0;
-    bytes_per_line = surface->pitch;
-    bytes_per_pixel = surface->format->BytesPerPixel;
-    line_length = area.w;
-    line_byte_offset = area.x * bytes_per_pixel;
+/*
+    Frames are converted from CGB colors to the format of the screen while
+    scaling, so SDL never has to convert them.
+*/
+static void select_format(SDL_PixelFormat *f) {
+    int format;
 
-    for(aline = 0; aline < area.h; fbline++) {
-        alines_to_fill = alines_in_fbline(aline, area.h, fbline);
-        if(alines_to_fill > 0) {
-            render_fbline_to_buffer(fbline);
+    if(f->BytesPerPixel == 2) {
+        format = f->Rmask == 0xF800 && f->Gmask == 0x07E0 && f->Bmask == 0x001F ? SCALE_FORMAT_RGB565 : SCALE_FORMAT_MASKED16;
+    }
+    else {
+        format = f->Rmask == 0xFF0000 && f->Gmask == 0x00FF00 && f->Bmask == 0x0000FF ? SCALE_FORMAT_XRGB8888 : SCALE_FORMAT_MASKED32;
+    }
 
-            for(buflines = 1; alines_to_fill >= buflines * 2; buflines *= 2) {
-                memcpy(&linebuf[buflines * bytes_per_line], linebuf, buflines * bytes_per_line);
-            }
-            fw_render_buffer(surface, linebuf, buflines, aline + area.y);
-            aline += buflines;
-            if(alines_to_fill > buflines) {
-                fw_render_buffer(surface, linebuf, alines_to_fill - buflines, aline + area.y);
-            }
-            aline += alines_to_fill - buflines;
-        }
+    scale_set_format(format, f->Rshift, f->Gshift, f->Bshift, f->Rloss, f->Gloss, f->Bloss);
+    // DMG shades are no LCD colors, so they are never corrected
+    scale_set_color_correction(sys.color_correction && moo.mode == CGB_MODE);
+}
+
+/*
+    An unscaled area of a surface in system memory is drawn to by the core
+    directly, unless rendering threaded.
+*/
+static void select_output(SDL_Surface *surface) {
+    void *pixels = NULL;
+
+    if(area.w == LCD_WIDTH && area.h == LCD_HEIGHT && lcd.render_mode != SYS_RENDER_THREADED &&
+       !(surface->flags & SDL_DOUBLEBUF) && !SDL_MUSTLOCK(surface)) {
+        pixels = (u8*)surface->pixels + area.y * surface->pitch + area.x * surface->format->BytesPerPixel;
+    }
+
+    if(pixels != lcd.output.pixels) {
+        lcd_set_output(pixels, surface->pitch, scale_line);
+        video_invalidate();
     }
 }
 
 void video_switch_display_mode() {
     SDL_Surface *screen = SDL_GetVideoSurface();
 
-    rshift = screen->format->Rshift + 3 - screen->format->Rloss;
-    gshift = screen->format->Gshift + 3 - screen->format->Gloss;
-    bshift = screen->format->Bshift + 3 - screen->format->Bloss;
+    lcd_set_output(NULL, 0, NULL);
+
+    select_format(screen->format);
 
-    memset(linebuf, 0x00, linebuf_size);
     SDL_FillRect(SDL_GetVideoSurface(), NULL, 0);
+    video_invalidate();
 }
 
 void video_init() {
-    linebuf_size = SDL_GetVideoSurface()->w * sys.bytes_per_pixel * (SDL_GetVideoSurface()->h/144 + 1);
-    linebuf = realloc(linebuf, linebuf_size * sizeof(*linebuf));
+    select_format(SDL_GetVideoSurface()->format);
 }
 
 void video_close() {
-    free(linebuf);
+    lcd_set_output(NULL, 0, NULL);
 }
 
 void video_set_area(SDL_Rect _area) {
-    int fbx, ax;
     area = _area;
-    for(ax = 0, fbx = 0; ax < area.w; fbx++) {
-        acolumns_in_fbpixel_buf[fbx] = acolumns_in_fbpixel(ax, area.w, fbx);
-        ax += acolumns_in_fbpixel_buf[fbx];
-    }
-
+    scale_set_width(area.w);
+    video_invalidate();
 }
 
-void video_render(SDL_Surface *surface) {
-    if(area.x == 0 && area.w == surface->w) {
-        fullwidth_render(surface);
-    }
-    else {
-        area_render(surface);
+/*
+    Renders the lines of lcd.clean_fb that differ from what the buffer drawn
+    to last showed and returns the areas of the surface that were written to
+    in _rects, which has to provide room for 144 rects. Returns the number of
+    rects.
+
+    If the core draws to the surface, it already holds lcd.clean_fb as long
+    as the core didn't start on the next frame, which it does only if the
+    frame wasn't presented during VBlank. Otherwise the frame is redrawn from
+    lcd.clean_fb completely and the surface holds no frame of the core's
+    until the next one is drawn.
+*/
+int video_render(SDL_Surface *surface, SDL_Rect *_rects) {
+    rects = _rects;
+    num_rects = 0;
+
+    select_output(surface);
+    if(lcd.output.pixels != NULL) {
+        if(lcd.output.complete == lcd.clean_fb) {
+            if(sys.fb_ready) {
+                add_rect(area.x, area.y, area.w, area.h);
+            }
+            return num_rects;
+        }
+        redraw_all[back] = 1;
+        lcd_invalidate_output();
     }
-}
 
-u16 sys_map_cgb_color(u16 lcd_color) {
-    return cgb_to_rgb(lcd_color);
-}
+    if(detect_changed_lines() == 0) {
+        return 0;
+    }
 
-u16 sys_map_dmg_color(u16 lcd_color) {
-    switch(lcd_color) {
-        case 0: return 0x1F<<rshift | 0x1F << gshift | 0x1F << bshift; break;
-        case 1: return 0x13<<rshift | 0x13 << gshift | 0x13 << bshift; break;
-        case 2: return 0x07<<rshift | 0x07 << gshift | 0x07 << bshift; break;
-        case 3: return 0x00<<rshift | 0x00 << gshift | 0x00 << bshift; break;
+    area_render(surface);
 
-        default: assert(0);
-    }
+    return num_rects;
 }
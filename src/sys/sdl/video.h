@@ -5,7 +5,9 @@
 
 void video_switch_display_mode();
 void video_set_area(SDL_Rect rect);
-void video_render(SDL_Surface *surface);
+void video_invalidate();
+void video_flipped();
+int video_render(SDL_Surface *surface, SDL_Rect *rects);
 void video_init();
 void video_close();
 
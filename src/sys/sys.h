@@ -25,6 +25,9 @@ typedef struct {
 
     int show_statusbar;
 
+    int render_mode;
+    int color_correction;
+
     int scalingmode;
     int num_scalingmodes;
     char **scalingmode_names;
@@ -37,14 +40,19 @@ typedef struct {
 
     unsigned int bits_per_pixel;
     unsigned int bytes_per_pixel;
-    unsigned int quantum_length;
+    unsigned int quantum_length; // M-cycles between two calls to sys_invoke()
+    int run_to_vblank; // Also call sys_invoke() at every VBlank
 } sys_t;
 
 #define SYS_AUTO_CONTINUE_NO 0
 #define SYS_AUTO_CONTINUE_ASK 1
 #define SYS_AUTO_CONTINUE_YES 2
 
-extern sys_t sys;
+#define SYS_RENDER_IMMEDIATE 0
+#define SYS_RENDER_DEFERRED 1
+#define SYS_RENDER_THREADED 2
+
+extern THREAD_LOCAL sys_t sys;
 
 
 void sys_init(int argc, const char** argv);
@@ -59,6 +67,7 @@ void sys_delay(int ticks);
 
 void sys_invoke();
 void sys_fb_ready();
+int sys_skip_frame();
 
 void sys_play_audio(int on);
 void sys_lock_audiobuf();
@@ -70,9 +79,6 @@ void sys_new_performance_info();
 
 void sys_set_scalingmode(int mode);
 
-u16 sys_map_cgb_color(u16 lcd_color);
-u16 sys_map_dmg_color(u16 lcd_color);
-
 //void sys_serial_connect();
 //void sys_serial_step();
 //int sys_serial_incoming();
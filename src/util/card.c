@@ -11,7 +11,7 @@
 #include "core/moo.h"
 #include "util/pathes.h"
 
-static FILE *file;
+static THREAD_LOCAL FILE *file;
 
 
 static void read(void *ptr, size_t size) {
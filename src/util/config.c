@@ -15,9 +15,9 @@ typedef struct { // TODO: Dynamic
     char val[64];
 } pair_t;
 
-static FILE *file;
-static pair_t **tuples = NULL;
-static int num_tuples;
+static THREAD_LOCAL FILE *file;
+static THREAD_LOCAL pair_t **tuples = NULL;
+static THREAD_LOCAL int num_tuples;
 
 typedef struct {
     char *name;
@@ -25,15 +25,29 @@ typedef struct {
     int default_val;
 } config_value_t;
 
-static config_value_t values[] = {
-    {"sound_on", &sys.sound_on, 1},
-    {"speed_factor", &speed.factor, 1},
-    {"scalingmode", &sys.scalingmode, 0},
-    {"show_statusbar", &sys.show_statusbar, 0},
-    {"auto_continue", &sys.auto_continue, SYS_AUTO_CONTINUE_ASK},
-    {"auto_rtc", &sys.auto_rtc, 1},
-    {"warned_rtc_sav_conflict", &sys.warned_rtc_sav_conflict, 0}
-};
+/*
+    The addresses of the thread local settings aren't constant, so the table
+    is built on every use.
+*/
+static void for_values(void (*func)(const config_value_t *value)) {
+    const config_value_t values[] = {
+        {"sound_on", &sys.sound_on, 1},
+        {"speed_factor", &speed.factor, 1},
+        {"scalingmode", &sys.scalingmode, 0},
+        {"render_mode", &sys.render_mode, SYS_RENDER_IMMEDIATE},
+        {"color_correction", &sys.color_correction, 0},
+        {"show_statusbar", &sys.show_statusbar, 0},
+        {"auto_continue", &sys.auto_continue, SYS_AUTO_CONTINUE_ASK},
+        {"auto_rtc", &sys.auto_rtc, 1},
+        {"run_to_vblank", &sys.run_to_vblank, 1},
+        {"warned_rtc_sav_conflict", &sys.warned_rtc_sav_conflict, 0}
+    };
+    int v;
+
+    for(v = 0; v < sizeof(values)/sizeof(*values); v++) {
+        func(&values[v]);
+    }
+}
 
 static void trim(char *str) {
     char *c;
@@ -51,6 +65,10 @@ static void save_int(const char *key, int ival) {
     save(key, val);
 }
 
+static void save_value(const config_value_t *value) {
+    save_int(value->name, *value->ptr);
+}
+
 static const char *load(const char *key) {
     int t;
     for(t = 0; t < num_tuples; t++) {
@@ -77,6 +95,14 @@ static int load_int(const char *key, int default_val) {
     return val;
 }
 
+static void load_value(const config_value_t *value) {
+    *value->ptr = load_int(value->name, value->default_val);
+}
+
+static void default_value(const config_value_t *value) {
+    *value->ptr = value->default_val;
+}
+
 static void clear() {
     int t;
 
@@ -123,10 +149,7 @@ static void config_save(const char *path) {
         return;
     }
 
-    int v;
-    for(v = 0; v < sizeof(values)/sizeof(*values); v++) {
-        save_int(values[v].name, *values[v].ptr);
-    }
+    for_values(save_value);
 
     fclose(file);
 }
@@ -142,10 +165,7 @@ static int config_load(const char *path) {
     parse();
     fclose(file);
 
-    int v;
-    for(v = 0; v < sizeof(values)/sizeof(*values); v++) {
-         *values[v].ptr = load_int(values[v].name, values[v].default_val);
-    }
+    for_values(load_value);
 
     clear();
 
@@ -161,10 +181,7 @@ static int config_load(const char *path) {
 }
 
 void config_default() {
-    int v;
-    for(v = 0; v < sizeof(values)/sizeof(*values); v++) {
-         *values[v].ptr = values[v].default_val;
-    }
+    for_values(default_value);
     sys_set_scalingmode(sys.scalingmode);
     speed_set_factor(speed.factor);
 }
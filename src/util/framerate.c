@@ -3,11 +3,13 @@
 #include "sys/sys.h"
 #include "core/cpu.h"
 #include "core/moo.h"
+#include "util/speed.h"
+#include "util/pacing.h"
 #include <stdio.h>
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
-framerate_t framerate;
+THREAD_LOCAL framerate_t framerate;
 
 void framerate_init() {
     framerate.frameskip = -1;
@@ -28,26 +30,45 @@ void framerate_begin() {
     framerate.cc_ahead = 0;
 }
 
+static int fixed_frameskip() {
+    if(framerate.skipped >= framerate.frameskip) {
+        framerate.skipped = 0;
+        return 1;
+    }
+    else {
+        framerate.skipped++;
+        return 0;
+    }
+}
+
+/*
+    While frames are paced, the core finished them on time, so every one is
+    presented, save those of a fixed frameskip. The millisecond ticks only
+    decide otherwise.
+*/
 int framerate_next_frame() {
     unsigned int should_framecount;
     int next_frame;
 
+    should_framecount = (sys.ticks - framerate.first_frame_ticks) * FRAMERATE_HZ / 1000;
+
+    if(pacing_active()) {
+        if(!sys.fb_ready) {
+            return 0;
+        }
+        // Don't catch up on these frames once pacing stops
+        framerate.framecount = should_framecount;
+        return framerate.frameskip >= 0 ? fixed_frameskip() : 1;
+    }
+
     // Check if we're in time for a next frame
-    should_framecount = ((sys.ticks - framerate.first_frame_ticks) * 60) / 1000;
     if(should_framecount <= framerate.framecount || !sys.fb_ready) {
         return 0;
     }
 
     // Fixed frameskip
     if(framerate.frameskip >= 0) {
-        if(framerate.skipped >= framerate.frameskip) {
-            framerate.skipped = 0;
-            next_frame = 1;
-        }
-        else {
-            framerate.skipped++;
-            next_frame = 0;
-        }
+        next_frame = fixed_frameskip();
     }
     else {
         // Autoframeskip, but we skipped too many
@@ -70,3 +91,19 @@ int framerate_next_frame() {
     return next_frame;
 }
 
+
+/*
+    Called by the core before it starts drawing a frame. While running faster
+    than realtime, a frame that begins after the current frame has already
+    been presented is most likely dropped anyway, so it is not drawn at all.
+*/
+int framerate_skip_next_frame() {
+    unsigned int should_framecount;
+
+    if(speed.factor == 1 || pacing_active()) {
+        return 0;
+    }
+
+    should_framecount = (sys.ticks - framerate.first_frame_ticks) * FRAMERATE_HZ / 1000;
+    return should_framecount <= framerate.framecount;
+}
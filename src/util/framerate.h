@@ -2,6 +2,10 @@
 #define SYS_ADJUST_FRAMERATE_H
 
 #include <time.h>
+#include "core/defines.h"
+
+// 4194304 Hz / 70224 dots per frame
+#define FRAMERATE_HZ 59.7275
 
 typedef struct {
     int frameskip;
@@ -14,11 +18,12 @@ typedef struct {
     size_t framecount;
 } framerate_t;
 
-extern framerate_t framerate;
+extern THREAD_LOCAL framerate_t framerate;
 
 void framerate_init();
 void framerate_reset();
 void framerate_begin();
 int framerate_next_frame();
+int framerate_skip_next_frame();
 
 #endif // SYS_ADJUST_FRAMERATE_H
@@ -0,0 +1,133 @@
+#include "histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+THREAD_LOCAL histogram_t histogram;
+
+const char *HISTOGRAM_REGION_NAMES[HISTOGRAM_NUM_REGIONS] = {
+    "rom0", "romx", "vram", "sram", "wram0", "wramx", "echo", "oam", "unusable", "io", "hram", "ie"
+};
+
+const u8 HISTOGRAM_REGIONS[16] = {
+    HISTOGRAM_ROM0, HISTOGRAM_ROM0, HISTOGRAM_ROM0, HISTOGRAM_ROM0,
+    HISTOGRAM_ROMX, HISTOGRAM_ROMX, HISTOGRAM_ROMX, HISTOGRAM_ROMX,
+    HISTOGRAM_VRAM, HISTOGRAM_VRAM, HISTOGRAM_SRAM, HISTOGRAM_SRAM,
+    HISTOGRAM_WRAM0, HISTOGRAM_WRAMX, HISTOGRAM_ECHO, HISTOGRAM_ECHO
+};
+
+#ifdef HISTOGRAM
+
+static histogram_t total;
+static pthread_mutex_t total_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t registered = PTHREAD_ONCE_INIT;
+
+static void add_ops(histogram_op_t *dst, const histogram_op_t *src) {
+    int op;
+
+    for(op = 0; op < 256; op++) {
+        dst[op].count += src[op].count;
+        dst[op].mcs += src[op].mcs;
+        dst[op].ticks += src[op].ticks;
+    }
+}
+
+static void add_counts(u64 *dst, const u64 *src, int length) {
+    int i;
+
+    for(i = 0; i < length; i++) {
+        dst[i] += src[i];
+    }
+}
+
+static void write_ops(FILE *file, const char *kind, const histogram_op_t *ops) {
+    int op;
+
+    for(op = 0; op < 256; op++) {
+        if(ops[op].count > 0) {
+            fprintf(file, "%s,%.2X,%llu,%llu,", kind, op, (unsigned long long)ops[op].count, (unsigned long long)ops[op].mcs);
+#ifdef HISTOGRAM_TICKS
+            fprintf(file, "%llu", (unsigned long long)ops[op].ticks);
+#endif
+            fprintf(file, "\n");
+        }
+    }
+}
+
+static void write_regions(FILE *file, const char *kind, const u64 *counts) {
+    int r;
+
+    for(r = 0; r < HISTOGRAM_NUM_REGIONS; r++) {
+        if(counts[r] > 0) {
+            fprintf(file, "%s,%s,%llu,,\n", kind, HISTOGRAM_REGION_NAMES[r], (unsigned long long)counts[r]);
+        }
+    }
+}
+
+static void write_registers(FILE *file, const char *kind, const u64 *counts) {
+    int reg;
+
+    for(reg = 0; reg < 0x80; reg++) {
+        if(counts[reg] > 0) {
+            fprintf(file, "%s,FF%.2X,%llu,,\n", kind, reg, (unsigned long long)counts[reg]);
+        }
+    }
+}
+
+// Exit handlers run before moo_close() of the main thread's emulator, so it is flushed here
+static void write_total() {
+    const char *path = getenv("MOOBOY_HISTOGRAM");
+    FILE *file;
+
+    histogram_flush();
+
+    if(path == NULL) {
+        path = "histogram.csv";
+    }
+    file = fopen(path, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to write histogram to '%s'\n", path);
+        return;
+    }
+
+    pthread_mutex_lock(&total_mutex);
+    fprintf(file, "kind,key,count,mcs,ticks\n");
+    write_ops(file, "op", total.ops);
+    write_ops(file, "cb", total.cb_ops);
+    write_regions(file, "read", total.reads);
+    write_regions(file, "write", total.writes);
+    write_registers(file, "io_read", total.io_reads);
+    write_registers(file, "io_write", total.io_writes);
+    pthread_mutex_unlock(&total_mutex);
+
+    fclose(file);
+}
+
+static void register_write_total() {
+    atexit(write_total);
+}
+
+#endif
+
+void histogram_init() {
+#ifdef HISTOGRAM
+    pthread_once(&registered, register_write_total);
+#endif
+}
+
+// Adds this thread's counts to the process' and restarts them
+void histogram_flush() {
+#ifdef HISTOGRAM
+    pthread_mutex_lock(&total_mutex);
+    add_ops(total.ops, histogram.ops);
+    add_ops(total.cb_ops, histogram.cb_ops);
+    add_counts(total.reads, histogram.reads, HISTOGRAM_NUM_REGIONS);
+    add_counts(total.writes, histogram.writes, HISTOGRAM_NUM_REGIONS);
+    add_counts(total.io_reads, histogram.io_reads, 0x80);
+    add_counts(total.io_writes, histogram.io_writes, 0x80);
+    pthread_mutex_unlock(&total_mutex);
+
+    memset(&histogram, 0x00, sizeof(histogram));
+#endif
+}
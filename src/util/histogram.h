@@ -0,0 +1,101 @@
+#ifndef UTIL_HISTOGRAM_H
+#define UTIL_HISTOGRAM_H
+
+#include "core/defines.h"
+
+/*
+    Histograms of executed opcodes (count, M-cycles and, with
+    HISTOGRAM_TICKS, host ticks including the hardware stepped by memory
+    accesses), memory accesses per region and IO register accesses. Each
+    emulator counts for itself, moo_close() adds its counts to the process'
+    and those are written as CSV at exit, to histogram.csv or the path in
+    $MOOBOY_HISTOGRAM. Echo RAM accesses are counted once more as WRAM ones.
+    Without HISTOGRAM defined the counting compiles to nothing.
+*/
+
+#define HISTOGRAM_ROM0     0
+#define HISTOGRAM_ROMX     1
+#define HISTOGRAM_VRAM     2
+#define HISTOGRAM_SRAM     3
+#define HISTOGRAM_WRAM0    4
+#define HISTOGRAM_WRAMX    5
+#define HISTOGRAM_ECHO     6
+#define HISTOGRAM_OAM      7
+#define HISTOGRAM_UNUSABLE 8
+#define HISTOGRAM_IO       9
+#define HISTOGRAM_HRAM     10
+#define HISTOGRAM_IE       11
+#define HISTOGRAM_NUM_REGIONS 12
+
+typedef struct {
+    u64 count;
+    u64 mcs;
+    u64 ticks;
+} histogram_op_t;
+
+typedef struct {
+    histogram_op_t ops[256];
+    histogram_op_t cb_ops[256];
+    u64 reads[HISTOGRAM_NUM_REGIONS];
+    u64 writes[HISTOGRAM_NUM_REGIONS];
+    u64 io_reads[0x80];
+    u64 io_writes[0x80];
+
+    u64 op_start;
+} histogram_t;
+
+extern THREAD_LOCAL histogram_t histogram;
+extern const char *HISTOGRAM_REGION_NAMES[HISTOGRAM_NUM_REGIONS];
+extern const u8 HISTOGRAM_REGIONS[16];
+
+#ifdef HISTOGRAM
+
+#ifdef HISTOGRAM_TICKS
+#include "profile.h"
+#endif
+
+static inline int histogram_region(u16 adr) {
+    if(adr < 0xFE00) return HISTOGRAM_REGIONS[adr >> 12];
+    if(adr < 0xFEA0) return HISTOGRAM_OAM;
+    if(adr < 0xFF00) return HISTOGRAM_UNUSABLE;
+    if(adr < 0xFF80) return HISTOGRAM_IO;
+    if(adr < 0xFFFF) return HISTOGRAM_HRAM;
+    return HISTOGRAM_IE;
+}
+
+static inline void histogram_op(u8 op, u8 cb, int mcs) {
+    histogram_op_t *entry = op == 0xCB ? &histogram.cb_ops[cb] : &histogram.ops[op];
+
+    entry->count++;
+    entry->mcs += mcs;
+#ifdef HISTOGRAM_TICKS
+    entry->ticks += profile_now() - histogram.op_start;
+#endif
+}
+
+#ifdef HISTOGRAM_TICKS
+#define HISTOGRAM_OP_BEGIN() (histogram.op_start = profile_now())
+#else
+#define HISTOGRAM_OP_BEGIN()
+#endif
+#define HISTOGRAM_OP_END(op, cb, mcs) histogram_op(op, cb, mcs)
+#define HISTOGRAM_READ(adr) (histogram.reads[histogram_region(adr)]++)
+#define HISTOGRAM_WRITE(adr) (histogram.writes[histogram_region(adr)]++)
+#define HISTOGRAM_IO_READ(reg) (histogram.io_reads[(reg) & 0x7F]++)
+#define HISTOGRAM_IO_WRITE(reg) (histogram.io_writes[(reg) & 0x7F]++)
+
+#else
+
+#define HISTOGRAM_OP_BEGIN()
+#define HISTOGRAM_OP_END(op, cb, mcs)
+#define HISTOGRAM_READ(adr)
+#define HISTOGRAM_WRITE(adr)
+#define HISTOGRAM_IO_READ(reg)
+#define HISTOGRAM_IO_WRITE(reg)
+
+#endif
+
+void histogram_init();
+void histogram_flush();
+
+#endif
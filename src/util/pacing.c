@@ -0,0 +1,104 @@
+#include "pacing.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "core/cpu.h"
+#include "util/speed.h"
+
+/*
+    Paces the emulation on the frames the core finishes: The deadline of a
+    frame is derived from the M-cycles emulated since the last one, so it
+    follows the hardware's refresh rate of 4194304/70224 Hz (~59.73 Hz) in
+    both CPU speeds, and frames the core skipped are accounted for as well.
+    The thread sleeps until shortly before the deadline and spins for the
+    rest, since sleeps may overshoot by more than that.
+*/
+
+THREAD_LOCAL pacing_t pacing;
+
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(long long t) {
+    struct timespec ts;
+
+    ts.tv_sec = t / 1000000000LL;
+    ts.tv_nsec = t % 1000000000LL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+static void add_sample(long long frame_time, long long expected) {
+    long long jitter = llabs(frame_time - expected) / 1000;
+
+    pacing.jitter[pacing.next_sample] = jitter;
+    pacing.next_sample = (pacing.next_sample + 1) % PACING_SAMPLES;
+    pacing.num_samples = min(pacing.num_samples + 1, PACING_SAMPLES);
+}
+
+void pacing_begin() {
+    pacing.deadline = now();
+    pacing.last_frame = 0;
+    pacing.last_cc = hw.cc;
+    pacing.num_samples = 0;
+    pacing.next_sample = 0;
+}
+
+void pacing_frame() {
+    long long t, frame_time;
+    hw_cycle_t cc = hw.cc - pacing.last_cc;
+
+    pacing.last_cc = hw.cc;
+    if(speed.factor >= SPEED_MAX_FACTOR) {
+        pacing.last_frame = 0;
+        return;
+    }
+
+    frame_time = cc * 1000000000LL / ((long long)cpu.freq * speed.factor);
+    pacing.deadline += frame_time;
+
+    t = now();
+    if(t - pacing.deadline > PACING_MAX_LAG_NS || pacing.last_frame == 0) {
+        pacing.deadline = t;
+    }
+    else {
+        if(pacing.deadline - t > PACING_SPIN_NS) {
+            sleep_until(pacing.deadline - PACING_SPIN_NS);
+        }
+        while((t = now()) < pacing.deadline) {}
+
+        add_sample(t - pacing.last_frame, frame_time);
+    }
+
+    pacing.last_frame = t;
+}
+
+int pacing_active() {
+    return pacing.last_frame != 0 && now() - pacing.last_frame < PACING_TIMEOUT_NS;
+}
+
+static int compare(const void *a, const void *b) {
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return x < y ? -1 : x > y;
+}
+
+// In ms, over the last PACING_SAMPLES frames
+void pacing_jitter_percentiles(float *p50, float *p95, float *p99) {
+    u32 sorted[PACING_SAMPLES];
+    int n = pacing.num_samples;
+
+    if(n == 0) {
+        *p50 = *p95 = *p99 = 0.0f;
+        return;
+    }
+
+    memcpy(sorted, pacing.jitter, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), compare);
+
+    *p50 = sorted[(n - 1) * 50 / 100] / 1000.0f;
+    *p95 = sorted[(n - 1) * 95 / 100] / 1000.0f;
+    *p99 = sorted[(n - 1) * 99 / 100] / 1000.0f;
+}
@@ -0,0 +1,33 @@
+#ifndef UTIL_PACING_H
+#define UTIL_PACING_H
+
+#include "core/defines.h"
+#include "core/hw.h"
+
+// Frames shorter than this before their deadline are spun instead of slept
+#define PACING_SPIN_NS 1000000LL
+// Being further behind than this drops the backlog
+#define PACING_MAX_LAG_NS 100000000LL
+// Inactive if no frame was paced for this long, speed_limit() takes over then
+#define PACING_TIMEOUT_NS 50000000LL
+
+#define PACING_SAMPLES 256
+
+typedef struct {
+    long long deadline; // ns, CLOCK_MONOTONIC
+    long long last_frame;
+    hw_cycle_t last_cc;
+
+    // Absolute deviation of the frame times from the emulated frame time in us
+    u32 jitter[PACING_SAMPLES];
+    int num_samples, next_sample;
+} pacing_t;
+
+extern THREAD_LOCAL pacing_t pacing;
+
+void pacing_begin();
+void pacing_frame();
+int pacing_active();
+void pacing_jitter_percentiles(float *p50, float *p95, float *p99);
+
+#endif
@@ -3,7 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-pathes_t pathes = {NULL};
+THREAD_LOCAL pathes_t pathes = {NULL};
 
 void pathes_rompath(const char *rompath) {
     pathes.rom = realloc(pathes.rom, strlen(rompath) + 1);
@@ -1,6 +1,8 @@
 #ifndef UTIL_PATHES_H
 #define UTIL_PATHES_H
 
+#include "core/defines.h"
+
 typedef struct {
     char *rom;
     char *romdir;
@@ -11,7 +13,7 @@ typedef struct {
     char *card;
 } pathes_t;
 
-extern pathes_t pathes;
+extern THREAD_LOCAL pathes_t pathes;
 
 void pathes_rompath(const char *rompath);
 void pathes_close();
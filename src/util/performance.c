@@ -2,27 +2,47 @@
 #include "core/cpu.h"
 #include "core/moo.h"
 #include "sys/sys.h"
+#include "util/pacing.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 
 
-performance_t performance;
+THREAD_LOCAL performance_t performance;
 
 const int PERFORMANCE_UPDATE_PERIOD = 250;
 
+#define FRAME_MCS 17556
+
 void performance_reset() {
     memset(&performance, 0x00, sizeof(performance));
 }
 
+/*
+    Adapts the quantum to the speed the emulation achieves, so the host gets
+    to poll input every PERFORMANCE_INPUT_LATENCY ms regardless of emulation
+    speed and with as few calls as possible.
+*/
+static void adapt_quantum() {
+    int quantum = (performance.update_cc / PERFORMANCE_UPDATE_PERIOD) * PERFORMANCE_INPUT_LATENCY;
+
+    quantum = max(quantum, PERFORMANCE_MIN_QUANTUM);
+    quantum = min(quantum, PERFORMANCE_MAX_QUANTUM * cpu.freq_factor);
+    sys.quantum_length = quantum;
+}
+
 void performance_invoked() {
     performance.update_cc += sys.invoke_cc;
+    performance.counting.invokes++;
 
     if(sys.ticks < performance.last_update_ticks + PERFORMANCE_UPDATE_PERIOD) {
         return;
     }
 
     performance.speed = (float)(performance.update_cc * 1000.0 * 100.0) / (cpu.freq * PERFORMANCE_UPDATE_PERIOD);
+    performance.quantum = performance.update_cc / max(performance.counting.invokes, 1);
+    adapt_quantum();
+    pacing_jitter_percentiles(&performance.jitter_p50, &performance.jitter_p95, &performance.jitter_p99);
 
     memcpy(&performance.counters, &performance.counting, sizeof(performance.counting));
     memset(&performance.counting, 0x00, sizeof(performance.counting));
@@ -33,3 +53,26 @@ void performance_invoked() {
     sys_new_performance_info();
 }
 
+
+/*
+    Ends an emulated second of scheduler counters and dumps them to stderr
+*/
+void performance_scheduler_second() {
+    performance_scheduler_counters_t *s = &performance.scheduler_counting;
+    float frames = (float)s->mcs / (FRAME_MCS * cpu.freq_factor);
+    int e;
+
+    fprintf(stderr, "Scheduler: %u steps (%.0f/frame), %u defers, peak queue %u, peak sched %u\n",
+            s->steps, s->steps / max(frames, 1.0f), s->defers, s->peak_queue, s->peak_sched);
+    for(e = 0; e < HW_NUM_EVENTS; e++) {
+        performance_event_counters_t *event = &s->events[e];
+
+        if(event->fires > 0 || event->schedules > 0 || event->unschedules > 0) {
+            fprintf(stderr, "  %-16s %6u fires/s, %5.2f late, %6u schedules, %6u unschedules\n", HW_EVENT_NAMES[e],
+                    event->fires, (float)event->lateness / max(event->fires, 1), event->schedules, event->unschedules);
+        }
+    }
+
+    memcpy(&performance.scheduler, s, sizeof(*s));
+    memset(s, 0x00, sizeof(*s));
+}
@@ -2,27 +2,57 @@
 #define SYS_PERFORMANCE_H
 
 #include <time.h>
+#include "core/defines.h"
+#include "core/hw.h"
 
 extern const int PERFORMANCE_UPDATE_PERIOD;
 
+// Bounds of sys.quantum_length in M-cycles
+#define PERFORMANCE_MIN_QUANTUM 1000
+#define PERFORMANCE_MAX_QUANTUM 17556
+// Host milliseconds between two calls to sys_invoke() sys.quantum_length aims for
+#define PERFORMANCE_INPUT_LATENCY 4
+
 typedef struct {
     unsigned int slept;
     unsigned int skipped;
     unsigned int frames;
+    unsigned int invokes;
 } performance_counters_t;
 
+typedef struct {
+    unsigned int fires;
+    unsigned int schedules;
+    unsigned int unschedules;
+    u64 lateness; // Sum of the M-cycles the callbacks were called late
+} performance_event_counters_t;
+
+typedef struct {
+    performance_event_counters_t events[HW_NUM_EVENTS];
+    unsigned int steps; // hw_step() calls
+    unsigned int defers;
+    unsigned int peak_queue, peak_sched;
+    hw_cycle_t mcs;
+} performance_scheduler_counters_t;
+
 typedef struct {
     performance_counters_t counters, counting;
 
+    // With HW_TELEMETRY, over the last emulated second
+    performance_scheduler_counters_t scheduler, scheduler_counting;
+
     float speed;
+    int quantum; // Average M-cycles run between two calls to sys_invoke()
+    float jitter_p50, jitter_p95, jitter_p99; // Frame time deviation in ms
 
     time_t last_update_ticks;
     int update_cc;
 } performance_t;
 
-extern performance_t performance;
+extern THREAD_LOCAL performance_t performance;
 
 void performance_reset();
 void performance_invoked();
+void performance_scheduler_second();
 
 #endif
@@ -0,0 +1,21 @@
+#include "profile.h"
+#include <string.h>
+
+THREAD_LOCAL profile_t profile;
+
+const char *PROFILE_ZONE_NAMES[PROFILE_NUM_ZONES] = {"cpu", "events", "ppu", "apu", "video"};
+
+void profile_reset() {
+    memset(&profile, 0x00, sizeof(profile));
+#ifdef PROFILE
+    profile.last = profile_now();
+#endif
+}
+
+// Charges the time since the last zone change, so the ticks add up to the time since profile_reset()
+void profile_sync() {
+#ifdef PROFILE
+    profile_enter(profile.zones[profile.depth]);
+    profile.depth--;
+#endif
+}
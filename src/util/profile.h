@@ -0,0 +1,82 @@
+#ifndef UTIL_PROFILE_H
+#define UTIL_PROFILE_H
+
+#include "core/defines.h"
+
+/*
+    Profile zones: Host time spent in the emulator, split by subsystem.
+    Zones nest, time is charged to the innermost zone only, and anything
+    outside of all zones is charged to PROFILE_CPU. Without PROFILE defined
+    the zones compile to nothing.
+*/
+
+#define PROFILE_CPU    0
+#define PROFILE_EVENTS 1
+#define PROFILE_PPU    2
+#define PROFILE_APU    3
+#define PROFILE_VIDEO  4
+#define PROFILE_NUM_ZONES 5
+
+#define PROFILE_MAX_DEPTH 16
+
+typedef struct {
+    u64 ticks[PROFILE_NUM_ZONES];
+    u64 instructions;
+
+    u64 last;
+    int zones[PROFILE_MAX_DEPTH];
+    int depth;
+} profile_t;
+
+extern THREAD_LOCAL profile_t profile;
+extern const char *PROFILE_ZONE_NAMES[PROFILE_NUM_ZONES];
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline u64 profile_now() {
+    return __rdtsc();
+}
+#else
+#include <time.h>
+
+static inline u64 profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#ifdef PROFILE
+
+static inline void profile_enter(int zone) {
+    u64 now = profile_now();
+
+    profile.ticks[profile.zones[profile.depth]] += now - profile.last;
+    profile.last = now;
+    profile.zones[++profile.depth] = zone;
+}
+
+static inline void profile_leave() {
+    u64 now = profile_now();
+
+    profile.ticks[profile.zones[profile.depth--]] += now - profile.last;
+    profile.last = now;
+}
+
+#define PROFILE_ENTER(zone) profile_enter(zone)
+#define PROFILE_LEAVE() profile_leave()
+#define PROFILE_INSTRUCTION() (profile.instructions++)
+
+#else
+
+#define PROFILE_ENTER(zone)
+#define PROFILE_LEAVE()
+#define PROFILE_INSTRUCTION()
+
+#endif
+
+void profile_reset();
+void profile_sync();
+
+#endif
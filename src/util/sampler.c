@@ -0,0 +1,281 @@
+#include "sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "core/cpu.h"
+#include "core/mem.h"
+#include "core/mbc.h"
+
+THREAD_LOCAL sampler_t sampler;
+
+#ifdef SAMPLER
+
+#define DEFAULT_PERIOD 997 // Prime, so samples don't lock onto the game's loops
+#define TABLE_SIZE 0x4000 // Entries, filled up to 3/4
+
+typedef struct sampler_table_s {
+    int width; // Locations per key
+    u32 *keys;
+    u8 *lengths;
+    u64 *samples;
+    u64 *depths;
+    int used;
+    u64 dropped;
+} table_t;
+
+static table_t *total_flat, *total_stacks;
+static int total_period;
+static pthread_mutex_t total_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t registered = PTHREAD_ONCE_INIT;
+
+static table_t *table_new(int width) {
+    table_t *table = calloc(1, sizeof(*table));
+
+    table->width = width;
+    table->keys = calloc(TABLE_SIZE * width, sizeof(*table->keys));
+    table->lengths = calloc(TABLE_SIZE, sizeof(*table->lengths));
+    table->samples = calloc(TABLE_SIZE, sizeof(*table->samples));
+    table->depths = calloc(TABLE_SIZE, sizeof(*table->depths));
+
+    return table;
+}
+
+static void table_free(table_t *table) {
+    if(table != NULL) {
+        free(table->keys);
+        free(table->lengths);
+        free(table->samples);
+        free(table->depths);
+        free(table);
+    }
+}
+
+// FNV-1a
+static u32 hash(const u32 *key, int length) {
+    u32 h = 2166136261u;
+    int i;
+
+    for(i = 0; i < length; i++) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void table_add(table_t *table, const u32 *key, int length, u64 samples, u64 depths) {
+    int slot = hash(key, length) & (TABLE_SIZE - 1);
+
+    for(;; slot = (slot + 1) & (TABLE_SIZE - 1)) {
+        u32 *slot_key = &table->keys[slot * table->width];
+
+        if(table->samples[slot] == 0) {
+            if(table->used >= TABLE_SIZE / 4 * 3) {
+                table->dropped += samples;
+                return;
+            }
+            memcpy(slot_key, key, length * sizeof(*key));
+            table->lengths[slot] = length;
+            table->used++;
+            break;
+        }
+        if(table->lengths[slot] == length && memcmp(slot_key, key, length * sizeof(*key)) == 0) {
+            break;
+        }
+    }
+
+    table->samples[slot] += samples;
+    table->depths[slot] += depths;
+}
+
+static void table_merge(table_t *dst, const table_t *src) {
+    int slot;
+
+    for(slot = 0; slot < TABLE_SIZE; slot++) {
+        if(src->samples[slot] > 0) {
+            table_add(dst, &src->keys[slot * src->width], src->lengths[slot], src->samples[slot], src->depths[slot]);
+        }
+    }
+    dst->dropped += src->dropped;
+}
+
+static u32 location(u16 adr) {
+    u32 bank = 0;
+
+    if(adr >= 0x4000 && adr < 0x8000) {
+        bank = (const u8(*)[0x4000])mbc.rombank - card.rombanks;
+    }
+    else if(adr >= 0xD000 && adr < 0xE000) {
+        bank = (u8(*)[0x1000])ram.rambank - ram.rambanks;
+    }
+
+    return bank << 16 | adr;
+}
+
+// Drops the frames returned from, i.e. whose return address is below above
+static void drop_frames(int above) {
+    while(sampler.depth > 0 && sampler.frames[sampler.depth - 1].sp < above) {
+        sampler.depth--;
+    }
+}
+
+// After the return address has been pushed
+void sampler_call(u16 adr) {
+    drop_frames(SP + 1);
+
+    if(sampler.depth == SAMPLER_MAX_DEPTH) {
+        memmove(&sampler.frames[0], &sampler.frames[1], sizeof(*sampler.frames) * (SAMPLER_MAX_DEPTH - 1));
+        sampler.depth--;
+    }
+    sampler.frames[sampler.depth].location = location(adr);
+    sampler.frames[sampler.depth].sp = SP;
+    sampler.depth++;
+}
+
+void sampler_sample() {
+    u32 key[SAMPLER_MAX_DEPTH + 1];
+    int f;
+
+    drop_frames(SP);
+
+    for(f = 0; f < sampler.depth; f++) {
+        key[f] = sampler.frames[f].location;
+    }
+    key[f] = location(PC);
+
+    table_add(sampler.flat, &key[f], 1, 1, sampler.depth);
+    table_add(sampler.stacks, key, sampler.depth + 1, 1, sampler.depth);
+}
+
+static FILE *open_output(const char *suffix) {
+    const char *prefix = getenv("MOOBOY_SAMPLER");
+    char path[4096];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s.%s", prefix != NULL ? prefix : "sampler", suffix);
+    file = fopen(path, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to write samples to '%s'\n", path);
+    }
+    return file;
+}
+
+static const table_t *sorting;
+
+static int compare_slots(const void *a, const void *b) {
+    u64 x = sorting->samples[*(const int*)a], y = sorting->samples[*(const int*)b];
+    return x > y ? -1 : x < y;
+}
+
+static void write_flat(FILE *file, const table_t *table) {
+    int *slots = malloc(sizeof(*slots) * TABLE_SIZE);
+    u64 total = table->dropped;
+    int slot, num_slots = 0;
+
+    for(slot = 0; slot < TABLE_SIZE; slot++) {
+        if(table->samples[slot] > 0) {
+            slots[num_slots++] = slot;
+            total += table->samples[slot];
+        }
+    }
+    sorting = table;
+    qsort(slots, num_slots, sizeof(*slots), compare_slots);
+
+    fprintf(file, "# %llu samples every %d M-cycles, %llu dropped\n", (unsigned long long)total, total_period, (unsigned long long)table->dropped);
+    fprintf(file, "%%       samples   location  depth\n");
+    for(slot = 0; slot < num_slots; slot++) {
+        u64 samples = table->samples[slots[slot]];
+        u32 pc = table->keys[slots[slot] * table->width];
+
+        fprintf(file, "%6.2f  %-9llu %.2X:%.4X   %.2f\n", 100.0 * samples / total, (unsigned long long)samples,
+                pc >> 16, pc & 0xFFFF, (double)table->depths[slots[slot]] / samples);
+    }
+
+    free(slots);
+}
+
+static void write_folded(FILE *file, const table_t *table) {
+    int slot, l;
+
+    for(slot = 0; slot < TABLE_SIZE; slot++) {
+        if(table->samples[slot] > 0) {
+            const u32 *key = &table->keys[slot * table->width];
+
+            for(l = 0; l < table->lengths[slot]; l++) {
+                fprintf(file, "%s%.2X:%.4X", l > 0 ? ";" : "", key[l] >> 16, key[l] & 0xFFFF);
+            }
+            fprintf(file, " %llu\n", (unsigned long long)table->samples[slot]);
+        }
+    }
+}
+
+// Exit handlers run before moo_close() of the main thread's emulator, so it is flushed here
+static void write_total() {
+    FILE *file;
+
+    sampler_flush();
+
+    pthread_mutex_lock(&total_mutex);
+    if(total_flat != NULL) {
+        if((file = open_output("flat")) != NULL) {
+            write_flat(file, total_flat);
+            fclose(file);
+        }
+        if((file = open_output("folded")) != NULL) {
+            write_folded(file, total_stacks);
+            fclose(file);
+        }
+    }
+    pthread_mutex_unlock(&total_mutex);
+}
+
+static void register_write_total() {
+    atexit(write_total);
+}
+
+#endif
+
+void sampler_init() {
+#ifdef SAMPLER
+    const char *period = getenv("MOOBOY_SAMPLER_PERIOD");
+
+    pthread_once(&registered, register_write_total);
+
+    sampler.period = period != NULL && atoi(period) > 0 ? atoi(period) : DEFAULT_PERIOD;
+    if(sampler.flat == NULL) {
+        sampler.flat = table_new(1);
+        sampler.stacks = table_new(SAMPLER_MAX_DEPTH + 1);
+    }
+    sampler_reset();
+#endif
+}
+
+void sampler_reset() {
+#ifdef SAMPLER
+    sampler.depth = 0;
+    sampler.countdown = sampler.period;
+#endif
+}
+
+// Adds this thread's samples to the process' and frees them
+void sampler_flush() {
+#ifdef SAMPLER
+    if(sampler.flat == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&total_mutex);
+    if(total_flat == NULL) {
+        total_flat = table_new(1);
+        total_stacks = table_new(SAMPLER_MAX_DEPTH + 1);
+    }
+    table_merge(total_flat, sampler.flat);
+    table_merge(total_stacks, sampler.stacks);
+    total_period = sampler.period;
+    pthread_mutex_unlock(&total_mutex);
+
+    table_free(sampler.flat);
+    table_free(sampler.stacks);
+    sampler.flat = NULL;
+    sampler.stacks = NULL;
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef UTIL_SAMPLER_H
+#define UTIL_SAMPLER_H
+
+#include "core/defines.h"
+
+/*
+    Sampling profiler of the emulated code: Every sampler.period M-cycles
+    ($MOOBOY_SAMPLER_PERIOD, 997 by default) the PC and the stack of
+    routines it was called from are counted. Locations are bank:address,
+    the ROM bank for 4000-7FFF, the WRAM bank for D000-DFFF and 0 for
+    everything else. Routines are tracked on calls, rsts and interrupts
+    and dropped once the stack pointer moves above their return address,
+    so games that pop return addresses or reset SP don't leave stale
+    frames. Each emulator samples for itself, moo_close() adds its samples
+    to the process' and those are written at exit, as a flat profile to
+    sampler.flat and as folded stacks for flamegraph.pl to sampler.folded
+    ($MOOBOY_SAMPLER.flat/.folded). Without SAMPLER defined the hooks
+    compile to nothing.
+*/
+
+#define SAMPLER_MAX_DEPTH 32
+
+typedef struct {
+    u32 location;
+    u16 sp; // Where the return address is
+} sampler_frame_t;
+
+typedef struct {
+    sampler_frame_t frames[SAMPLER_MAX_DEPTH];
+    int depth;
+
+    int period;
+    int countdown;
+
+    struct sampler_table_s *flat, *stacks;
+} sampler_t;
+
+extern THREAD_LOCAL sampler_t sampler;
+
+#ifdef SAMPLER
+
+void sampler_call(u16 adr);
+void sampler_sample();
+
+static inline void sampler_step(int mcs) {
+    sampler.countdown -= mcs;
+    if(sampler.countdown <= 0) {
+        sampler.countdown += sampler.period;
+        sampler_sample();
+    }
+}
+
+#define SAMPLER_CALL(adr) sampler_call(adr)
+#define SAMPLER_STEP(mcs) sampler_step(mcs)
+
+#else
+
+#define SAMPLER_CALL(adr)
+#define SAMPLER_STEP(mcs)
+
+#endif
+
+void sampler_init();
+void sampler_reset();
+void sampler_flush();
+
+#endif
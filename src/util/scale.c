@@ -0,0 +1,478 @@
+#include "scale.h"
+#include <string.h>
+#include "core/lcd.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALE_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCALE_NEON
+#endif
+
+/*
+    A framebuffer line (15 bit CGB colors) is first converted to the output
+    format, then scaled to the output width by nearest neighbour. Source
+    pixel x covers runs[x] destination pixels, as many as there are between
+    (x * width)/160 and ((x+1) * width)/160.
+*/
+
+scale_t scale;
+
+static int runs[LCD_WIDTH];
+static u32 converted[LCD_WIDTH];
+
+// CGB color -> output pixel
+static u16 lut16[0x8000];
+static u32 lut32[0x8000];
+
+#define CGB_R(c) ((c) & 0x1F)
+#define CGB_G(c) (((c) >> 5) & 0x1F)
+#define CGB_B(c) (((c) >> 10) & 0x1F)
+#define EXPAND8(v) (((v) << 3) | ((v) >> 2))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+
+static void convert_rgb565(const u16 *src, void *_dst) {
+    u16 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALE_SSE2)
+    const __m128i mask = _mm_set1_epi16(0x1F);
+    for(; x < LCD_WIDTH; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        __m128i r = _mm_and_si128(v, mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask);
+        __m128i b = _mm_and_si128(_mm_srli_epi16(v, 10), mask);
+        __m128i g6 = _mm_or_si128(_mm_slli_epi16(g, 6), _mm_slli_epi16(_mm_srli_epi16(g, 4), 5));
+        _mm_storeu_si128((__m128i*)&dst[x], _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), g6), b));
+    }
+#elif defined(SCALE_NEON)
+    const uint16x8_t mask = vdupq_n_u16(0x1F);
+    for(; x < LCD_WIDTH; x += 8) {
+        uint16x8_t v = vld1q_u16(&src[x]);
+        uint16x8_t r = vandq_u16(v, mask);
+        uint16x8_t g = vandq_u16(vshrq_n_u16(v, 5), mask);
+        uint16x8_t b = vandq_u16(vshrq_n_u16(v, 10), mask);
+        uint16x8_t g6 = vorrq_u16(vshlq_n_u16(g, 6), vshlq_n_u16(vshrq_n_u16(g, 4), 5));
+        vst1q_u16(&dst[x], vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), g6), b));
+    }
+#endif
+
+    for(; x < LCD_WIDTH; x++) {
+        u16 g = CGB_G(src[x]);
+        dst[x] = (CGB_R(src[x]) << 11) | (g << 6) | ((g >> 4) << 5) | CGB_B(src[x]);
+    }
+}
+
+static void convert_xrgb8888(const u16 *src, void *_dst) {
+    u32 *dst = _dst;
+    int x = 0;
+
+#if defined(SCALE_SSE2)
+    const __m128i mask = _mm_set1_epi16(0x1F);
+    for(; x < LCD_WIDTH; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        __m128i r = _mm_and_si128(v, mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask);
+        __m128i b = _mm_and_si128(_mm_srli_epi16(v, 10), mask);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        __m128i gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+        _mm_storeu_si128((__m128i*)&dst[x], _mm_unpacklo_epi16(gb, r));
+        _mm_storeu_si128((__m128i*)&dst[x + 4], _mm_unpackhi_epi16(gb, r));
+    }
+#elif defined(SCALE_NEON)
+    const uint16x8_t mask = vdupq_n_u16(0x1F);
+    for(; x < LCD_WIDTH; x += 8) {
+        uint16x8_t v = vld1q_u16(&src[x]);
+        uint16x8_t r = vandq_u16(v, mask);
+        uint16x8_t g = vandq_u16(vshrq_n_u16(v, 5), mask);
+        uint16x8_t b = vandq_u16(vshrq_n_u16(v, 10), mask);
+        r = vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2));
+        g = vorrq_u16(vshlq_n_u16(g, 3), vshrq_n_u16(g, 2));
+        b = vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2));
+
+        uint16x8x2_t p = vzipq_u16(vorrq_u16(vshlq_n_u16(g, 8), b), r);
+        vst1q_u32(&dst[x], vreinterpretq_u32_u16(p.val[0]));
+        vst1q_u32(&dst[x + 4], vreinterpretq_u32_u16(p.val[1]));
+    }
+#endif
+
+    for(; x < LCD_WIDTH; x++) {
+        dst[x] = (EXPAND8(CGB_R(src[x])) << 16) | (EXPAND8(CGB_G(src[x])) << 8) | EXPAND8(CGB_B(src[x]));
+    }
+}
+
+static void convert_lut16(const u16 *src, void *_dst) {
+    u16 *dst = _dst;
+    int x;
+    for(x = 0; x < LCD_WIDTH; x++) {
+        dst[x] = lut16[src[x]];
+    }
+}
+
+static void convert_lut32(const u16 *src, void *_dst) {
+    u32 *dst = _dst;
+    int x;
+    for(x = 0; x < LCD_WIDTH; x++) {
+        dst[x] = lut32[src[x]];
+    }
+}
+
+/*
+    Approximates the colors of the CGB LCD, which mixes the channels and
+    can't display full intensity.
+*/
+static void correct_color(u32 *r, u32 *g, u32 *b) {
+    u32 cr = *r * 26 + *g * 4 + *b * 2;
+    u32 cg = *g * 24 + *b * 8;
+    u32 cb = *r * 6 + *g * 4 + *b * 22;
+
+    *r = min(cr, 960) >> 2;
+    *g = min(cg, 960) >> 2;
+    *b = min(cb, 960) >> 2;
+}
+
+static void build_lut() {
+    u32 c, r, g, b, pixel;
+
+    for(c = 0; c < 0x8000; c++) {
+        if(scale.color_correction) {
+            r = CGB_R(c);
+            g = CGB_G(c);
+            b = CGB_B(c);
+            correct_color(&r, &g, &b);
+        }
+        else {
+            r = EXPAND8(CGB_R(c));
+            g = EXPAND8(CGB_G(c));
+            b = EXPAND8(CGB_B(c));
+        }
+
+        pixel = ((r >> scale.rloss) << scale.rshift) |
+                ((g >> scale.gloss) << scale.gshift) |
+                ((b >> scale.bloss) << scale.bshift);
+
+        if(scale.bytes_per_pixel == 2) {
+            lut16[c] = pixel;
+        }
+        else {
+            lut32[c] = pixel;
+        }
+    }
+}
+
+
+#if defined(SCALE_SSE2)
+    typedef __m128i vec_t;
+    #define vec_set1_16(p) _mm_set1_epi16(p)
+    #define vec_set1_32(p) _mm_set1_epi32(p)
+    #define vec_store(dst, v) _mm_storeu_si128((__m128i*)(dst), v)
+#elif defined(SCALE_NEON)
+    typedef uint16x8_t vec_t;
+    #define vec_set1_16(p) vdupq_n_u16(p)
+    #define vec_set1_32(p) vreinterpretq_u16_u32(vdupq_n_u32(p))
+    #define vec_store(dst, v) vst1q_u16((u16*)(dst), v)
+#endif
+
+/*
+    Writes every run with full vector stores, each store may overshoot the
+    run by up to one vector, which gets overwritten by the following runs. So
+    only runs followed by at least 8 source pixels are vector stored, every
+    one of them covers at least one destination pixel if width >= 160.
+*/
+#if defined(SCALE_SSE2) || defined(SCALE_NEON)
+#define VECTOR_RUNS(type, set1) \
+    for(x = 0; x < LCD_WIDTH - 8; x++) { \
+        vec_t v = set1(src[x]); \
+        run = factor ? factor : runs[x]; \
+        for(i = 0; i < run; i += 16 / sizeof(type)) { \
+            vec_store(&dst[i], v); \
+        } \
+        dst += run; \
+    }
+#else
+#define VECTOR_RUNS(type, set1) x = 0;
+#endif
+
+#define SCALE_RUNS(type, set1) \
+static inline void scale_runs_##type(const type *src, type *dst, int factor) { \
+    int x, i, run; \
+    VECTOR_RUNS(type, set1) \
+    for(; x < LCD_WIDTH; x++) { \
+        run = factor ? factor : runs[x]; \
+        for(i = 0; i < run; i++) { \
+            dst[i] = src[x]; \
+        } \
+        dst += run; \
+    } \
+}
+
+SCALE_RUNS(u16, vec_set1_16)
+SCALE_RUNS(u32, vec_set1_32)
+
+static void scale_1x_u16(const void *src, void *dst) {
+    memcpy(dst, src, LCD_WIDTH * sizeof(u16));
+}
+
+static void scale_1x_u32(const void *src, void *dst) {
+    memcpy(dst, src, LCD_WIDTH * sizeof(u32));
+}
+
+static void scale_2x_u16(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x;
+
+#if defined(SCALE_SSE2)
+    for(x = 0; x < LCD_WIDTH; x += 8, dst += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128((__m128i*)&dst[8], _mm_unpackhi_epi16(v, v));
+    }
+#elif defined(SCALE_NEON)
+    for(x = 0; x < LCD_WIDTH; x += 8, dst += 16) {
+        uint16x8_t v = vld1q_u16(&src[x]);
+        uint16x8x2_t d = vzipq_u16(v, v);
+        vst1q_u16(&dst[0], d.val[0]);
+        vst1q_u16(&dst[8], d.val[1]);
+    }
+#else
+    for(x = 0; x < LCD_WIDTH; x++, dst += 2) {
+        dst[0] = dst[1] = src[x];
+    }
+#endif
+}
+
+static void scale_2x_u32(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x;
+
+#if defined(SCALE_SSE2)
+    for(x = 0; x < LCD_WIDTH; x += 4, dst += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi32(v, v));
+        _mm_storeu_si128((__m128i*)&dst[4], _mm_unpackhi_epi32(v, v));
+    }
+#elif defined(SCALE_NEON)
+    for(x = 0; x < LCD_WIDTH; x += 4, dst += 8) {
+        uint32x4_t v = vld1q_u32(&src[x]);
+        uint32x4x2_t d = vzipq_u32(v, v);
+        vst1q_u32(&dst[0], d.val[0]);
+        vst1q_u32(&dst[4], d.val[1]);
+    }
+#else
+    for(x = 0; x < LCD_WIDTH; x++, dst += 2) {
+        dst[0] = dst[1] = src[x];
+    }
+#endif
+}
+
+static void scale_3x_u16(const void *src, void *dst) {
+    scale_runs_u16(src, dst, 3);
+}
+
+static void scale_3x_u32(const void *src, void *dst) {
+    scale_runs_u32(src, dst, 3);
+}
+
+static void scale_4x_u16(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x;
+
+#if defined(SCALE_SSE2)
+    for(x = 0; x < LCD_WIDTH; x += 8, dst += 32) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        __m128i lo = _mm_unpacklo_epi16(v, v);
+        __m128i hi = _mm_unpackhi_epi16(v, v);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi32(lo, lo));
+        _mm_storeu_si128((__m128i*)&dst[8], _mm_unpackhi_epi32(lo, lo));
+        _mm_storeu_si128((__m128i*)&dst[16], _mm_unpacklo_epi32(hi, hi));
+        _mm_storeu_si128((__m128i*)&dst[24], _mm_unpackhi_epi32(hi, hi));
+    }
+#elif defined(SCALE_NEON)
+    for(x = 0; x < LCD_WIDTH; x += 8, dst += 32) {
+        uint16x8_t v = vld1q_u16(&src[x]);
+        uint16x8x2_t d = vzipq_u16(v, v);
+        uint16x8x2_t lo = vzipq_u16(d.val[0], d.val[0]);
+        uint16x8x2_t hi = vzipq_u16(d.val[1], d.val[1]);
+        vst1q_u16(&dst[0], lo.val[0]);
+        vst1q_u16(&dst[8], lo.val[1]);
+        vst1q_u16(&dst[16], hi.val[0]);
+        vst1q_u16(&dst[24], hi.val[1]);
+    }
+#else
+    for(x = 0; x < LCD_WIDTH; x++, dst += 4) {
+        dst[0] = dst[1] = dst[2] = dst[3] = src[x];
+    }
+#endif
+}
+
+static void scale_4x_u32(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x;
+
+#if defined(SCALE_SSE2)
+    for(x = 0; x < LCD_WIDTH; x += 4, dst += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+        __m128i lo = _mm_unpacklo_epi32(v, v);
+        __m128i hi = _mm_unpackhi_epi32(v, v);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi64(lo, lo));
+        _mm_storeu_si128((__m128i*)&dst[4], _mm_unpackhi_epi64(lo, lo));
+        _mm_storeu_si128((__m128i*)&dst[8], _mm_unpacklo_epi64(hi, hi));
+        _mm_storeu_si128((__m128i*)&dst[12], _mm_unpackhi_epi64(hi, hi));
+    }
+#elif defined(SCALE_NEON)
+    for(x = 0; x < LCD_WIDTH; x++, dst += 4) {
+        vst1q_u32(dst, vdupq_n_u32(src[x]));
+    }
+#else
+    for(x = 0; x < LCD_WIDTH; x++, dst += 4) {
+        dst[0] = dst[1] = dst[2] = dst[3] = src[x];
+    }
+#endif
+}
+
+static void scale_5x_u16(const void *src, void *dst) {
+    scale_runs_u16(src, dst, 5);
+}
+
+static void scale_5x_u32(const void *src, void *dst) {
+    scale_runs_u32(src, dst, 5);
+}
+
+static void scale_6x_u16(const void *src, void *dst) {
+    scale_runs_u16(src, dst, 6);
+}
+
+static void scale_6x_u32(const void *src, void *dst) {
+    scale_runs_u32(src, dst, 6);
+}
+
+static void scale_fractional_u16(const void *src, void *dst) {
+    scale_runs_u16(src, dst, 0);
+}
+
+static void scale_fractional_u32(const void *src, void *dst) {
+    scale_runs_u32(src, dst, 0);
+}
+
+static void scale_fractional_down_u16(const void *_src, void *_dst) {
+    const u16 *src = _src;
+    u16 *dst = _dst;
+    int x, i;
+
+    for(x = 0; x < LCD_WIDTH; x++) {
+        for(i = 0; i < runs[x]; i++) {
+            *dst++ = src[x];
+        }
+    }
+}
+
+static void scale_fractional_down_u32(const void *_src, void *_dst) {
+    const u32 *src = _src;
+    u32 *dst = _dst;
+    int x, i;
+
+    for(x = 0; x < LCD_WIDTH; x++) {
+        for(i = 0; i < runs[x]; i++) {
+            *dst++ = src[x];
+        }
+    }
+}
+
+static void select_converter() {
+    if(scale.format == SCALE_FORMAT_RGB565 && !scale.color_correction) {
+        scale.convert = convert_rgb565;
+    }
+    else if(scale.format == SCALE_FORMAT_XRGB8888 && !scale.color_correction) {
+        scale.convert = convert_xrgb8888;
+    }
+    else {
+        build_lut();
+        scale.convert = scale.bytes_per_pixel == 2 ? convert_lut16 : convert_lut32;
+    }
+}
+
+static const scale_kernel_t kernels_u16[] = {scale_fractional_u16, scale_1x_u16, scale_2x_u16, scale_3x_u16, scale_4x_u16, scale_5x_u16, scale_6x_u16};
+static const scale_kernel_t kernels_u32[] = {scale_fractional_u32, scale_1x_u32, scale_2x_u32, scale_3x_u32, scale_4x_u32, scale_5x_u32, scale_6x_u32};
+
+static void select_kernel() {
+    int bpp32 = scale.bytes_per_pixel == 4;
+
+    if(scale.width < LCD_WIDTH) {
+        scale.kernel = bpp32 ? scale_fractional_down_u32 : scale_fractional_down_u16;
+    }
+    else {
+        scale.kernel = bpp32 ? kernels_u32[scale.factor] : kernels_u16[scale.factor];
+    }
+}
+
+void scale_set_width(int width) {
+    int x, w;
+
+    for(x = 0, w = 0; x < LCD_WIDTH; x++) {
+        runs[x] = (((x + 1) * width) / LCD_WIDTH) - w;
+        w += runs[x];
+    }
+
+    scale.width = width;
+    scale.factor = width % LCD_WIDTH == 0 ? width / LCD_WIDTH : 0;
+    if(scale.factor > 6) {
+        scale.factor = 0;
+    }
+
+    select_kernel();
+}
+
+/*
+    The shifts and losses describe the position and precision of each 8 bit
+    channel in the pixel. RGB565 and XRGB8888 are converted arithmetically
+    unless colors are corrected, everything else through a lookup table.
+*/
+void scale_set_format(int format, int rshift, int gshift, int bshift, int rloss, int gloss, int bloss) {
+    scale.format = format;
+    scale.rshift = rshift;
+    scale.gshift = gshift;
+    scale.bshift = bshift;
+    scale.rloss = rloss;
+    scale.gloss = gloss;
+    scale.bloss = bloss;
+
+    scale.bytes_per_pixel = format == SCALE_FORMAT_RGB565 || format == SCALE_FORMAT_MASKED16 ? 2 : 4;
+
+    select_converter();
+    select_kernel();
+}
+
+void scale_set_color_correction(int on) {
+    scale.color_correction = on;
+    select_converter();
+}
+
+void scale_line(const u16 *src, void *dst) {
+    if(scale.factor == 1) {
+        scale.convert(src, dst);
+    }
+    else {
+        scale.convert(src, converted);
+        scale.kernel(converted, dst);
+    }
+}
+
+const char *scale_simd_name() {
+#if defined(SCALE_SSE2)
+    return "sse2";
+#elif defined(SCALE_NEON)
+    return "neon";
+#else
+    return "c";
+#endif
+}
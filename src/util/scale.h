@@ -0,0 +1,36 @@
+#ifndef UTIL_SCALE_H
+#define UTIL_SCALE_H
+
+#include "core/defines.h"
+
+#define SCALE_FORMAT_RGB565 0
+#define SCALE_FORMAT_XRGB8888 1
+#define SCALE_FORMAT_MASKED16 2
+#define SCALE_FORMAT_MASKED32 3
+
+typedef void (*scale_convert_t)(const u16 *src, void *dst);
+typedef void (*scale_kernel_t)(const void *src, void *dst);
+
+typedef struct {
+    int width;
+    int factor; // Integer factor, 0 if resampled
+
+    int format;
+    int bytes_per_pixel;
+    int rshift, gshift, bshift;
+    int rloss, gloss, bloss;
+    int color_correction;
+
+    scale_convert_t convert;
+    scale_kernel_t kernel;
+} scale_t;
+
+extern scale_t scale;
+
+void scale_set_width(int width);
+void scale_set_format(int format, int rshift, int gshift, int bshift, int rloss, int gloss, int bloss);
+void scale_set_color_correction(int on);
+void scale_line(const u16 *src, void *dst);
+const char *scale_simd_name();
+
+#endif
@@ -2,8 +2,9 @@
 #include "core/cpu.h"
 #include "sys/sys.h"
 #include "util/performance.h"
+#include "util/pacing.h"
 
-speed_t speed;
+THREAD_LOCAL speed_t speed;
 
 void speed_reset() {
     speed.factor = 1;
@@ -14,9 +15,19 @@ void speed_begin() {
     speed.last_limit_check = 0;
 }
 
+/*
+    Only limits the speed while pacing isn't, i.e. while the core doesn't
+    produce frames.
+*/
 void speed_limit() {
     int period = sys.ticks - (long)speed.last_limit_check;
 
+    if(pacing_active()) {
+        speed.cc_ahead = 0;
+        speed.last_limit_check = sys.ticks;
+        return;
+    }
+
     speed.cc_ahead += sys.invoke_cc;
     speed.cc_ahead -= (period * cpu.freq * speed.factor)/1000;
 
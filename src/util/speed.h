@@ -2,6 +2,7 @@
 #define UTIL_SPEED_H
 
 #include <time.h>
+#include "core/defines.h"
 
 #define SPEED_MAX_FACTOR 10
 #define SPEED_DELAY_THRESHOLD 1
@@ -12,7 +13,7 @@ typedef struct {
     time_t last_limit_check;
 } speed_t;
 
-extern speed_t speed;
+extern THREAD_LOCAL speed_t speed;
 
 void speed_reset();
 void speed_begin();
@@ -13,48 +13,41 @@
 #include "core/mbc.h"
 #include "core/moo.h"
 #include "core/mem.h"
-#include "core/maps.h"
 #include "core/timers.h"
 #include "core/sound.h"
 #include "core/lcd.h"
+#include "core/hw.h"
 #include "core/defines.h"
 
 #define BYTE(val) ((u8)(val))
 
-#define LCD_MODE_0_EVENT_ID 0
-#define LCD_MODE_1_EVENT_ID 1
-#define LCD_MODE_2_EVENT_ID 2
-#define LCD_MODE_3_EVENT_ID 3
-#define LCD_VBLANK_LINE_EVENT_ID 4
-#define SOUND_MIX_EVENT_ID 5
-#define SOUND_SWEEP_EVENT_ID 6
-#define SOUND_ENVELOPES_EVENT_ID 7
-#define SOUND_LENGTH_COUNTERS_EVENT_ID 8
-#define TIMERS_TIMA_EVENT_ID 9
-#define TIMER_DIV_EVENT_ID 10
-#define RTC_EVENT_ID 11
-#define NUM_HW_EVENTS 12
-
-static hw_event_t *id2event[] = {
-    &lcd.mode_event[0], &lcd.mode_event[1], &lcd.mode_event[2], &lcd.mode_event[3],
-    &lcd.vblank_line_event, &sound_mix_event, &sound_sweep_event, &sound_envelopes_event,
-    &sound_length_counters_event, &timers_tima_event, &timers_div_event, &rtc_event
-};
-
 #define STATE_PREFIX "mbs"
-static const u8 STATE_REVISION = 0x01;
+static const u8 STATE_REVISION = 0x03;
+
+// Layout of lcd_frame_t, which depends on the build
+#define FRAME_FORMAT_COLORS  0
+#define FRAME_FORMAT_INDEXED 1
+#ifdef LCD_INDEXED_FB
+#define FRAME_FORMAT FRAME_FORMAT_INDEXED
+#else
+#define FRAME_FORMAT FRAME_FORMAT_COLORS
+#endif
 
-static FILE *f;
-static u8 byte;
-static u8 loading_revision;
+static THREAD_LOCAL FILE *f;
+static THREAD_LOCAL u8 byte;
+static THREAD_LOCAL u8 loading_revision;
 
+// Values are part of revisions first to last, gaps are skipped when loading
 typedef struct {
     void *ptr;
     int size;
+    u8 first, last;
 } value_t;
 
-#define V(v) {&(v), sizeof(v)}
-#define VA(v) {(v), sizeof(v)}
+#define V(v) {&(v), sizeof(v), 0x01, 0xFF}
+#define VA(v) {(v), sizeof(v), 0x01, 0xFF}
+#define V_SINCE(r, v) {&(v), sizeof(v), (r), 0xFF}
+#define GAP_UNTIL(r, size) {NULL, (size), 0x01, (r)}
 
 #define S(v) fwrite(&v, sizeof(v), 1, f)
 #define R(v) fread(&v, sizeof(v), 1, f)
@@ -68,119 +61,122 @@ typedef struct {
 
 #define _env(e) V((e).sweep), V((e).tick), V((e).dir)
 
-#define NUM_VALUES (sizeof(values)/sizeof(*values))
-
-static value_t values[] = {
-    V(cpu.af), V(cpu.bc), V(cpu.de), V(cpu.hl),
-    V(SP), V(PC),
-    V(cpu.op), V(cpu.cb),
-    V(cpu.ime), V(cpu.irq), V(cpu.ie),
-    V(cpu.remainder),
-    V(cpu.freq),
-    V(cpu.freq_factor),
-    V(cpu.freq_switch),
-    V(cpu.halted),
-    V(joy.col),
-    VA(lcd.fb),
-    V(lcd.c),
-    V(lcd.stat),
-    V(lcd.scx), V(lcd.scy),
-    V(lcd.ly), V(lcd.lyc),
-    V(lcd.wx), V(lcd.wy),
-    VA(lcd.bgp.b), VA(lcd.obp.b),
-    VA(lcd.bgp.d), VA(lcd.obp.d),
-    V(lcd.bgp.s), V(lcd.bgp.i),
-    V(lcd.obp.s), V(lcd.obp.i),
-    V(lcd.hdma_source), V(lcd.hdma_dest),
-    V(lcd.hdma_length), V(lcd.hdma_inactive),
-    V(mbc.type),
-    V(mbc.has_rtc),
-    V(mbc.has_battery),
-    V(mbc1.mode),
-    V(mbc1.rombank),
-    V(mbc3.mode),
-    V(mbc5.rombank),
-    V(card.romsize),
-    V(card.sramsize),
-    VA(card.srambanks),
-    VA(ram.rambanks),
-    VA(ram.vrambanks),
-    VA(ram.hram),
-    VA(ram.oam),
-    V(ram.rambank_index),
-    VA(rtc.latched),
-    VA(rtc.ticking),
-    V(rtc.mapped),
-    V(rtc.prelatched),
-    V(sound.on),
-    V(sound.so1_volume), V(sound.so2_volume),
-    V(sound.mix_threshold),
-    V(sound.cc_reset),
-    V(sound.remainder),
-    _sqw(sqw[0]), _sqw(sqw[1]),
-    _env(env[0]), _env(env[1]), _env(env[2]),
-    V(sweep.period), V(sweep.dir), V(sweep.shift), V(sweep.tick),
-    V(wave.on),
-    V(wave.cc), V(wave.cc_reset),
-    V(wave.l), V(wave.r),
-    V(wave.freq),
-    V(wave.shift),
-    VA(wave.data),
-    V(wave.counter.length), V(wave.counter.expires),
-    V(noise.on),
-    V(noise.cc), V(noise.cc_reset),
-    V(noise.l), V(noise.r),
-    V(noise.volume),
-    V(noise.shift),
-    V(noise.width),
-    V(noise.divr),
-    V(noise.lsfr),
-    V(noise.counter.length), V(noise.counter.expires),
-    V(timers.div), V(timers.tima), V(timers.tma), V(timers.tac),
-    V(timers.div_cc), V(timers.tima_cc),
-    V(sys.ticks),
-    V(sys.invoke_cc),
-    V(framerate.skipped),
-    V(framerate.delay_threshold),
-    V(framerate.first_frame_ticks),
-    V(framerate.framecount),
-    V(speed.cc_ahead),
-    V(speed.last_limit_check),
-    V(hw.cc)
-};
+/*
+    The addresses of the thread local state aren't constant, so the table is
+    built on every use. Returns the index of the first value of the revision
+    that wasn't transferred completely, or -1.
+*/
+static int for_values(u8 revision, size_t (*transfer)(void *ptr, size_t size)) {
+    const value_t values[] = {
+        V(cpu.af), V(cpu.bc), V(cpu.de), V(cpu.hl),
+        V(SP), V(PC),
+        V(cpu.op), V(cpu.cb),
+        V(cpu.ime), V(cpu.irq), V(cpu.ie),
+        V(cpu.remainder),
+        V(cpu.freq),
+        V(cpu.freq_factor),
+        V(cpu.freq_switch),
+        V(cpu.halted),
+        V(joy.col),
+        GAP_UNTIL(0x01, 2 * LCD_WIDTH * LCD_HEIGHT * sizeof(u16)), // The framebuffers
+        V(lcd.c),
+        V(lcd.stat),
+        V(lcd.scx), V(lcd.scy),
+        V(lcd.ly), V(lcd.lyc),
+        V(lcd.wx), V(lcd.wy),
+        VA(lcd.bgp.b), VA(lcd.obp.b),
+        VA(lcd.bgp.d), VA(lcd.obp.d),
+        V(lcd.bgp.s), V(lcd.bgp.i),
+        V(lcd.obp.s), V(lcd.obp.i),
+        V(lcd.hdma_source), V(lcd.hdma_dest),
+        V(lcd.hdma_length), V(lcd.hdma_inactive),
+        V_SINCE(0x02, lcd.dma_source), V_SINCE(0x02, lcd.dma_active),
+        V(mbc.type),
+        V(mbc.has_rtc),
+        V(mbc.has_battery),
+        V(mbc1.mode),
+        V(mbc1.rombank),
+        V(mbc3.mode),
+        V(mbc5.rombank),
+        V(card.romsize),
+        V(card.sramsize),
+        VA(card.srambanks),
+        VA(ram.rambanks),
+        VA(ram.vrambanks),
+        VA(ram.hram),
+        VA(ram.oam),
+        V(ram.rambank_index),
+        VA(rtc.latched),
+        VA(rtc.ticking),
+        V(rtc.mapped),
+        V(rtc.prelatched),
+        V(sound.on),
+        V(sound.so1_volume), V(sound.so2_volume),
+        V(sound.mix_threshold),
+        V(sound.cc_reset),
+        V(sound.remainder),
+        _sqw(sqw[0]), _sqw(sqw[1]),
+        _env(env[0]), _env(env[1]), _env(env[2]),
+        V(sweep.period), V(sweep.dir), V(sweep.shift), V(sweep.tick),
+        V(wave.on),
+        V(wave.cc), V(wave.cc_reset),
+        V(wave.l), V(wave.r),
+        V(wave.freq),
+        V(wave.shift),
+        VA(wave.data),
+        V(wave.counter.length), V(wave.counter.expires),
+        V(noise.on),
+        V(noise.cc), V(noise.cc_reset),
+        V(noise.l), V(noise.r),
+        V(noise.volume),
+        V(noise.shift),
+        V(noise.width),
+        V(noise.divr),
+        V(noise.lsfr),
+        V(noise.counter.length), V(noise.counter.expires),
+        V(timers.div), V(timers.tima), V(timers.tma), V(timers.tac),
+        V(timers.div_cc), V(timers.tima_cc),
+        V(sys.ticks),
+        V(sys.invoke_cc),
+        V(framerate.skipped),
+        V(framerate.delay_threshold),
+        V(framerate.first_frame_ticks),
+        V(framerate.framecount),
+        V(speed.cc_ahead),
+        V(speed.last_limit_check),
+        V(hw.cc)
+    };
+    int v;
+
+    for(v = 0; v < sizeof(values)/sizeof(*values); v++) {
+        if(revision < values[v].first || revision > values[v].last) {
+            continue;
+        }
+        if(transfer(values[v].ptr, values[v].size) != values[v].size) {
+            return v;
+        }
+    }
+    return -1;
+}
 
 static void save_prefix() {
     fprintf(f, "%s", STATE_PREFIX);
     S(STATE_REVISION);
 }
 
-static void save_values() {
-    int v;
-    for(v = 0; v < NUM_VALUES; v++) {
-        fwrite(values[v].ptr, 1, values[v].size, f);
-    }
+static size_t save_value(void *ptr, size_t size) {
+    return fwrite(ptr, 1, size, f);
 }
 
-static u8 hw_event_to_id(hw_event_t *event) {
-    if(event == &lcd.mode_event[0]) return LCD_MODE_0_EVENT_ID;
-    if(event == &lcd.mode_event[1]) return LCD_MODE_1_EVENT_ID;
-    if(event == &lcd.mode_event[2]) return LCD_MODE_2_EVENT_ID;
-    if(event == &lcd.mode_event[3]) return LCD_MODE_3_EVENT_ID;
-    if(event == &lcd.vblank_line_event) return LCD_VBLANK_LINE_EVENT_ID;
-    if(event == &sound_mix_event) return SOUND_MIX_EVENT_ID;
-    if(event == &sound_sweep_event) return SOUND_SWEEP_EVENT_ID;
-    if(event == &sound_envelopes_event) return SOUND_ENVELOPES_EVENT_ID;
-    if(event == &sound_length_counters_event) return SOUND_LENGTH_COUNTERS_EVENT_ID;
-    if(event == &timers_tima_event) return TIMERS_TIMA_EVENT_ID;
-    if(event == &timers_div_event) return TIMER_DIV_EVENT_ID;
-    if(event == &rtc_event) return RTC_EVENT_ID;
-    assert(0);
+static void save_values() {
+    for_values(STATE_REVISION, save_value);
 }
 
 static void save_hw_queue(hw_event_t *q) {
     hw_event_t *event;
     for(event = q; event != NULL; event = event->next) {
-        byte = hw_event_to_id(event); S(byte);
+        assert(event->id >= 0 && event->id < HW_NUM_EVENTS);
+        byte = event->id; S(byte);
         S(event->mcs);
     }
     byte = 0xFF; S(byte);
@@ -194,12 +190,32 @@ static void save_hw() {
 
 
 static void save_misc() {
-    byte = (u8(*)[0x4000])mbc.rombank - card.rombanks; S(byte);
+    byte = (const u8(*)[0x4000])mbc.rombank - card.rombanks; S(byte);
     byte = (u8(*)[0x2000])mbc.srambank - card.srambanks; S(byte);
     byte = (u8(*)[0x1000])ram.rambank - ram.rambanks; S(byte);
     save_hw();
 }
 
+// Indexed, only the palette snapshots in use
+static void save_frame(lcd_frame_t *frame) {
+    S(frame->pixels);
+#ifdef LCD_INDEXED_FB
+    S(frame->line_palettes);
+    S(frame->num_palettes);
+    fwrite(frame->palettes, sizeof(*frame->palettes), frame->num_palettes, f);
+#endif
+}
+
+/*
+    The newest complete frame, after lcd_flush() that of the render thread
+    too, and the one being drawn
+*/
+static void save_frames() {
+    byte = FRAME_FORMAT; S(byte);
+    save_frame(lcd.pending_fb != NULL ? lcd.pending_fb : lcd.clean_fb);
+    save_frame(lcd.working_fb);
+}
+
 void state_save(const char *filename) {
     printf("Saving state to '%s'\n", filename);
 
@@ -209,15 +225,18 @@ void state_save(const char *filename) {
         return;
     }
 
+    lcd_flush();
+
     save_prefix();
     save_values();
     save_misc();
+    save_frames();
 
     fclose(f);
 }
 
 static int load_prefix() {
-    char buf[sizeof(STATE_PREFIX)];
+    char buf[sizeof(STATE_PREFIX)] = {0};
 
     int read = fread(buf, 1, sizeof(buf)-1, f);
     if(read != sizeof(buf)-1 || strcmp(buf, STATE_PREFIX)) {
@@ -228,24 +247,62 @@ static int load_prefix() {
         moo_errorf("Savestate too small");
         return 1;
     }
+    // Revision 2 framebuffers have the layout of the build that saved them
+    if(loading_revision == 0x00 || loading_revision == 0x02 || loading_revision > STATE_REVISION) {
+        moo_errorf("Savestate revision %i is not supported", loading_revision);
+        return 1;
+    }
 
     return 0;
 }
 
+static size_t load_value(void *ptr, size_t size) {
+    if(ptr == NULL) {
+        return fseek(f, size, SEEK_CUR) == 0 ? size : 0;
+    }
+    return fread(ptr, 1, size, f);
+}
+
+// Values older revisions don't have, as after a reset
+static void load_defaults() {
+    if(loading_revision < 0x02) {
+        lcd.dma_source = 0x0000;
+        lcd.dma_active = 0;
+    }
+    if(loading_revision < 0x03) {
+        // Counted iterations instead of M-cycles
+        sys.invoke_cc = 0;
+    }
+}
+
 static int load_values() {
-    int v;
-    for(v = 0; v < NUM_VALUES; v++) {
-        size_t read = fread(values[v].ptr, 1, values[v].size, f);
-        if(read != values[v].size) {
-            moo_errorf("Savestate corrupt at value %i", v);
-            return 1;
-        }
+    u16 romsize = card.romsize;
+    int v = for_values(loading_revision, load_value);
+
+    if(v >= 0) {
+        moo_errorf("Savestate corrupt at value %i", v);
+        return 1;
+    }
+    load_defaults();
+    // The ROM itself isn't part of the state
+    if(card.romsize != romsize) {
+        card.romsize = romsize;
+        moo_errorf("Savestate is of a different ROM");
+        return 1;
     }
     return 0;
 }
 
 static hw_event_t *hw_id_to_event(u8 id) {
-    if(id < NUM_HW_EVENTS) {
+    hw_event_t *id2event[] = {
+        &lcd.mode_event[0], &lcd.mode_event[1], &lcd.mode_event[2], &lcd.mode_event[3],
+        &lcd.vblank_line_event, &sound_mix_event, &sound_sweep_event, &sound_envelopes_event,
+        &sound_length_counters_event, &timers_tima_event, &timers_div_event, &rtc_event,
+        &lcd.dma_event
+    };
+
+    if(id < HW_NUM_EVENTS) {
+        assert(id2event[id]->id == id);
         return id2event[id];
     }
     else {
@@ -258,19 +315,19 @@ static int load_hw_queue() {
     u8 id;
     hw_cycle_t mcs;
     hw_event_t *event;
-    int scheduled[NUM_HW_EVENTS] = {0};
+    int scheduled[HW_NUM_EVENTS] = {0};
 
     for(R(id); id != 0xFF; R(id)) {
-        if(scheduled[id]) {
-            moo_errorf("Savestate is corrupt #2");
+        event = hw_id_to_event(id);
+        if(event == NULL) {
             return 1;
         }
-        scheduled[id] = 1;
 
-        event = hw_id_to_event(id);
-        if(event == NULL) {
+        if(scheduled[id]) {
+            moo_errorf("Savestate is corrupt #2");
             return 1;
         }
+        scheduled[id] = 1;
 #ifdef DEBUG
         event->dbg_queued = 0;
 #endif
@@ -297,14 +354,80 @@ static int load_misc() {
 
     joy.state = 0xFF;
 
-    error |= fread(&byte, 1, 1, f) != 1; mbc.rombank = card.rombanks[byte];
+    error |= fread(&byte, 1, 1, f) != 1; mbc.rombank = card.rombanks[byte % card.romsize];
     error |= fread(&byte, 1, 1, f) != 1; mbc.srambank = card.srambanks[byte & 0x03];
     error |= fread(&byte, 1, 1, f) != 1; ram.rambank = ram.rambanks[byte & 0x07];
     error |= load_hw();
 
-    maps_dirty();
     lcd_rebuild_palette_maps();
+    lcd_render_dirty();
+
+    return error;
+}
+
+static int load_frame(lcd_frame_t *frame) {
+    int error = R(frame->pixels) != 1;
+#ifdef LCD_INDEXED_FB
+    int ly;
+
+    error |= R(frame->line_palettes) != 1;
+    error |= R(frame->num_palettes) != 1;
+    error |= frame->num_palettes > LCD_HEIGHT;
+    error = error || fread(frame->palettes, sizeof(*frame->palettes), frame->num_palettes, f) != frame->num_palettes;
+    for(ly = 0; ly < LCD_HEIGHT && !error; ly++) {
+        error |= frame->line_palettes[ly] >= frame->num_palettes;
+    }
+#endif
+    return error;
+}
+
+static int skip_frame(u8 format) {
+    u8 num_palettes;
+
+    if(format == FRAME_FORMAT_COLORS) {
+        return fseek(f, LCD_WIDTH * LCD_HEIGHT * sizeof(u16), SEEK_CUR) != 0;
+    }
+    if(fseek(f, LCD_WIDTH * LCD_HEIGHT + LCD_HEIGHT, SEEK_CUR) != 0 || R(num_palettes) != 1) {
+        return 1;
+    }
+    return fseek(f, num_palettes * LCD_PALETTE_SLOTS * sizeof(u16), SEEK_CUR) != 0;
+}
+
+/*
+    The finished frame is loaded as the presented one. Frames of a build
+    with another framebuffer format are skipped, they are blank until the
+    next frame is drawn, as are those of revision 1, which are skipped with
+    the values.
+*/
+static int load_frames() {
+    int error = 0;
+    u8 format;
 
+    lcd_flush();
+    lcd.clean_fb = &lcd.fb[0];
+    lcd.working_fb = &lcd.fb[1];
+    lcd.pending_fb = NULL;
+    lcd_invalidate_output();
+
+    if(loading_revision < 0x03) {
+        memset(lcd.fb, 0x00, sizeof(lcd.fb));
+    }
+    else if(R(format) != 1 || format > FRAME_FORMAT_INDEXED) {
+        error = 1;
+    }
+    else if(format == FRAME_FORMAT) {
+        error |= load_frame(lcd.clean_fb);
+        error |= load_frame(lcd.working_fb);
+    }
+    else {
+        error |= skip_frame(format);
+        error |= skip_frame(format);
+        memset(lcd.fb, 0x00, sizeof(lcd.fb));
+    }
+
+    if(error) {
+        moo_errorf("Savestate is corrupt: Invalid framebuffer");
+    }
     return error;
 }
 
@@ -316,7 +439,7 @@ int state_load(const char *filename) {
         return 0;
     }
 
-    if( load_prefix() || load_values() || load_misc())  {
+    if( load_prefix() || load_values() || load_misc() || load_frames())  {
         fclose(f);
         return 0;
     }